@@ -18,6 +18,7 @@
 
 
 #include <stdio.h>
+#include <string.h>
 
 #include "deh_main.h"
 
@@ -28,6 +29,7 @@
 #include "p_local.h"
 #include "w_wad.h"
 
+#include "m_bbox.h"
 #include "m_cheat.h"
 #include "m_controls.h"
 #include "m_misc.h"
@@ -133,6 +135,14 @@ typedef struct
     fixed_t slp, islp;
 } islope_t;
 
+// a line as clipped for the view amview
+typedef struct
+{
+    unsigned int view;
+    boolean visible;
+    fline_t fl;
+} amline_t;
+
 
 
 //
@@ -267,6 +277,20 @@ cheatseq_t cheat_amap = CHEAT("iddt", 0);
 
 static boolean stopped = true;
 
+// what the last drawn walls layer was drawn from
+static amline_t *amlines; // per linedef
+static unsigned int amview; // bumped whenever the view changes
+static int *amwalls; // line<<8 | color of the walls to draw
+static int numamwalls;
+static int *amlayerwalls; // amwalls when amlayer was drawn
+static int numamlayerwalls;
+static byte amlayer[SCREENWIDTH*SCREENHEIGHT];
+static boolean amlayervalid;
+static int amlayergrid;
+static fixed_t amlayer_m_x, amlayer_m_y, amlayer_m_x2, amlayer_m_y2;
+static fixed_t amlayer_scale;
+static int amlayer_w, amlayer_h;
+
 // Calculates the slope and slope according to the x-axis of a line
 // segment in map coordinates (with the upright y-axis n' all) so
 // that it can be used with the brain-dead drawing stuff.
@@ -1020,6 +1044,21 @@ AM_drawFline
     x = fl->a.x;
     y = fl->a.y;
 
+    // Most walls are straight, and come out the same as a span
+    // or a column.
+    if (!dy)
+    {
+	memset(&fb[y*f_w + (dx<0 ? fl->b.x : x)], color, (ax>>1) + 1);
+	return;
+    }
+
+    if (!dx)
+    {
+	for (d = ay>>1 ; d >= 0 ; d--, y += sy)
+	    PUTDOT(x, y, color);
+	return;
+    }
+
     if (ax > ay)
     {
 	d = ay - ax/2;
@@ -1117,57 +1156,155 @@ void AM_drawGrid(int color)
 }
 
 //
-// Determines visible lines, draws them.
+// The color a line is drawn in, or -1 if it is not drawn.
+//
+int AM_wallColor(line_t* line)
+{
+    if (cheating || (line->flags & ML_MAPPED))
+    {
+	if ((line->flags & LINE_NEVERSEE) && !cheating)
+	    return -1;
+	if (!line->backsector)
+	    return WALLCOLORS+lightlev;
+	if (line->special == 39)
+	{ // teleporters
+	    return WALLCOLORS+WALLRANGE/2;
+	}
+	else if (line->flags & ML_SECRET) // secret door
+	{
+	    if (cheating) return SECRETWALLCOLORS + lightlev;
+	    else return WALLCOLORS+lightlev;
+	}
+	else if (line->backsector->floorheight
+		 != line->frontsector->floorheight) {
+	    return FDWALLCOLORS + lightlev; // floor level change
+	}
+	else if (line->backsector->ceilingheight
+		 != line->frontsector->ceilingheight) {
+	    return CDWALLCOLORS+lightlev; // ceiling level change
+	}
+	else if (cheating) {
+	    return TSWALLCOLORS+lightlev;
+	}
+    }
+    else if (plr->powers[pw_allmap])
+    {
+	if (!(line->flags & LINE_NEVERSEE)) return GRAYS+3;
+    }
+
+    return -1;
+}
+
+//
+// Determines visible lines and their colors.
 // This is LineDef based, not LineSeg based.
+// A line is clipped once for each view and
+// then kept in amlines until the view changes.
 //
-void AM_drawWalls(void)
+void AM_findWalls(void)
 {
     int i;
-    static mline_t l;
+    int color;
+    line_t* line;
+    amline_t* al;
+    mline_t l;
+
+    numamwalls = 0;
 
     for (i=0;i<numlines;i++)
     {
-	l.a.x = lines[i].v1->x;
-	l.a.y = lines[i].v1->y;
-	l.b.x = lines[i].v2->x;
-	l.b.y = lines[i].v2->y;
-	if (cheating || (lines[i].flags & ML_MAPPED))
-	{
-	    if ((lines[i].flags & LINE_NEVERSEE) && !cheating)
-		continue;
-	    if (!lines[i].backsector)
-	    {
-		AM_drawMline(&l, WALLCOLORS+lightlev);
-	    }
-	    else
-	    {
-		if (lines[i].special == 39)
-		{ // teleporters
-		    AM_drawMline(&l, WALLCOLORS+WALLRANGE/2);
-		}
-		else if (lines[i].flags & ML_SECRET) // secret door
-		{
-		    if (cheating) AM_drawMline(&l, SECRETWALLCOLORS + lightlev);
-		    else AM_drawMline(&l, WALLCOLORS+lightlev);
-		}
-		else if (lines[i].backsector->floorheight
-			   != lines[i].frontsector->floorheight) {
-		    AM_drawMline(&l, FDWALLCOLORS + lightlev); // floor level change
-		}
-		else if (lines[i].backsector->ceilingheight
-			   != lines[i].frontsector->ceilingheight) {
-		    AM_drawMline(&l, CDWALLCOLORS+lightlev); // ceiling level change
-		}
-		else if (cheating) {
-		    AM_drawMline(&l, TSWALLCOLORS+lightlev);
-		}
-	    }
-	}
-	else if (plr->powers[pw_allmap])
+	line = &lines[i];
+
+	// the trivial rejects of AM_clipMline
+	if (line->bbox[BOXBOTTOM] > m_y2 || line->bbox[BOXTOP] < m_y
+	    || line->bbox[BOXLEFT] > m_x2 || line->bbox[BOXRIGHT] < m_x)
+	    continue;
+
+	color = AM_wallColor(line);
+	if (color < 0)
+	    continue;
+
+	al = &amlines[i];
+	if (al->view != amview)
 	{
-	    if (!(lines[i].flags & LINE_NEVERSEE)) AM_drawMline(&l, GRAYS+3);
+	    l.a.x = line->v1->x;
+	    l.a.y = line->v1->y;
+	    l.b.x = line->v2->x;
+	    l.b.y = line->v2->y;
+	    al->visible = AM_clipMline(&l, &al->fl);
+	    al->view = amview;
 	}
+
+	if (al->visible)
+	    amwalls[numamwalls++] = (i << 8) | color;
+    }
+}
+
+//
+// Draws the lines AM_findWalls found.
+//
+void AM_drawWalls(void)
+{
+    int i;
+
+    for (i=0;i<numamwalls;i++)
+	AM_drawFline(&amlines[amwalls[i] >> 8].fl, amwalls[i] & 0xff);
+}
+
+//
+// Background, grid and walls.  These are copied from amlayer
+// while the view is the same and the same lines are drawn in
+// the same colors.
+//
+void AM_drawLayer(void)
+{
+    if (!amlines)
+    {
+	amlines = Z_Malloc(numlines * sizeof(*amlines), PU_LEVEL, &amlines);
+	memset(amlines, 0, numlines * sizeof(*amlines));
+	amwalls = Z_Malloc(numlines * sizeof(*amwalls), PU_LEVEL, &amwalls);
+	amlayerwalls = Z_Malloc(numlines * sizeof(*amlayerwalls),
+				PU_LEVEL, &amlayerwalls);
+	amview++;
+	amlayervalid = false;
     }
+
+    if (m_x != amlayer_m_x || m_y != amlayer_m_y
+	|| m_x2 != amlayer_m_x2 || m_y2 != amlayer_m_y2
+	|| scale_mtof != amlayer_scale || f_w != amlayer_w || f_h != amlayer_h)
+    {
+	amlayer_m_x = m_x;
+	amlayer_m_y = m_y;
+	amlayer_m_x2 = m_x2;
+	amlayer_m_y2 = m_y2;
+	amlayer_scale = scale_mtof;
+	amlayer_w = f_w;
+	amlayer_h = f_h;
+	amview++;
+	amlayervalid = false;
+    }
+
+    AM_findWalls();
+
+    if (amlayervalid && grid == amlayergrid
+	&& numamwalls == numamlayerwalls
+	&& !memcmp(amwalls, amlayerwalls, numamwalls * sizeof(*amwalls)))
+    {
+	memcpy(fb, amlayer, f_w*f_h);
+	return;
+    }
+
+    AM_clearFB(BACKGROUND);
+    if (grid)
+	AM_drawGrid(GRIDCOLORS);
+    AM_drawWalls();
+
+    memcpy(amlayer, fb, f_w*f_h);
+    amlayervalid = true;
+    amlayergrid = grid;
+
+    memcpy(amlayerwalls, amwalls, numamwalls * sizeof(*amwalls));
+    numamlayerwalls = numamwalls;
 }
 
 
@@ -1339,10 +1476,7 @@ void AM_Drawer (void)
 {
     if (!automapactive) return;
 
-    AM_clearFB(BACKGROUND);
-    if (grid)
-	AM_drawGrid(GRIDCOLORS);
-    AM_drawWalls();
+    AM_drawLayer();
     AM_drawPlayers();
     if (cheating==2)
 	AM_drawThings(THINGCOLORS, THINGRANGE);
@@ -25,6 +25,9 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <kinc/threads/semaphore.h>
+#include <kinc/threads/thread.h>
+
 #include "config.h"
 #include "deh_main.h"
 #include "doomdef.h"
@@ -46,11 +49,13 @@
 #include "f_wipe.h"
 
 #include "m_argv.h"
+#include "m_bench.h"
 #include "m_config.h"
 #include "m_controls.h"
 #include "m_misc.h"
 #include "m_menu.h"
 #include "p_saveg.h"
+#include "p_tick.h"
 
 #include "i_endoom.h"
 #include "i_joystick.h"
@@ -68,6 +73,7 @@
 #include "net_dedicated.h"
 #include "net_query.h"
 
+#include "p_local.h"
 #include "p_setup.h"
 #include "r_local.h"
 #include "statdump.h"
@@ -95,6 +101,7 @@ char *          iwadfile;
 
 
 boolean		devparm;	// started game with -devparm
+boolean		uncapped;	// checkparm of -uncapped
 boolean         nomonsters;	// checkparm of -nomonsters
 boolean         respawnparm;	// checkparm of -respawn
 boolean         fastparm;	// checkparm of -fast
@@ -163,6 +170,12 @@ extern  boolean setsizeneeded;
 extern  int             showMessages;
 void R_ExecuteSetViewSize (void);
 
+// set while a sliced wipe is in progress, see D_Display
+static bool     wiping = false;
+
+// set when -pipeline drew the view while the tic ran
+static boolean  viewdrawn;
+
 void D_Display (void)
 {
     // SOKOL CHANGE
@@ -170,7 +183,6 @@ void D_Display (void)
     // function, which doesn't work in a frame callback scenario. Thus
     // the wipe effect has been sliced and the D_Display() function split
     // into a "wiping" and "non-wiping" state which can be called per frame
-    static bool wiping = false;
     if (wiping) {
         wiping = !wipe_ScreenWipe(wipe_Melt, 0, 0, SCREENWIDTH, SCREENHEIGHT, 1);
         I_UpdateNoBlit ();
@@ -246,10 +258,12 @@ void D_Display (void)
         // draw buffered stuff to screen
         I_UpdateNoBlit ();
 
-        // draw the view directly
-        if (gamestate == GS_LEVEL && !automapactive && gametic)
+        // draw the view directly, unless -pipeline drew it already
+        if (gamestate == GS_LEVEL && !automapactive && gametic && !viewdrawn)
             R_RenderPlayerView (&players[displayplayer]);
 
+        viewdrawn = false;
+
         if (gamestate == GS_LEVEL && gametic)
             HU_Drawer ();
 
@@ -320,6 +334,116 @@ void D_Display (void)
     // SOKOL CHANGE: the model wiping loop used to live here
 }
 
+//
+// PIPELINED TICKER
+// With -pipeline, P_Ticker runs on a worker thread while the main
+// thread draws the view of the previous tic from a snapshot (see
+// r_snap.c).  The playsim runs exactly as before, so demos stay in
+// sync; the view lags the status bar and HUD by one tic.
+//
+
+static boolean          pipeline;
+static kinc_thread_t    tickerthread;
+static kinc_semaphore_t tickerstart;
+static kinc_semaphore_t tickerdone;
+
+static void TickerThread (void *param)
+{
+    while (true)
+    {
+        kinc_semaphore_wait (&tickerstart);
+
+        M_BenchBegin (bench_ticker);
+        P_Ticker ();
+        M_BenchEnd (bench_ticker);
+
+        kinc_semaphore_signal (&tickerdone);
+    }
+}
+
+
+//
+// D_InitPipeline
+//
+static void D_InitPipeline (void)
+{
+    int i;
+
+    //!
+    // Run the playsim on its own thread, overlapped with drawing
+    // the view of the previous tic.
+    //
+
+    if (!M_CheckParm ("-pipeline"))
+        return;
+
+    // The view is drawn while the playsim allocates from the
+    // zone, so the renderer must not need the zone at all.
+    for (i = 0; i < numlumps; i++)
+    {
+        if (lumpinfo[i].wad_file->mapped == NULL)
+        {
+            printf ("D_InitPipeline: %.8s is not memory mapped, "
+                    "not pipelining\n", lumpinfo[i].name);
+            return;
+        }
+    }
+
+    R_LockComposites ();
+
+    kinc_semaphore_init (&tickerstart, 0, 1);
+    kinc_semaphore_init (&tickerdone, 0, 1);
+    kinc_thread_init (&tickerthread, TickerThread, NULL);
+
+    pipeline = true;
+}
+
+
+//
+// D_RunTicker
+// Called by G_Ticker in place of P_Ticker.
+//
+void D_RunTicker (void)
+{
+    viewdrawn = false;
+
+    if (uncapped)
+        P_StoreInterpolations ();
+
+    if (!pipeline)
+    {
+        M_BenchBegin (bench_ticker);
+        P_Ticker ();
+        M_BenchEnd (bench_ticker);
+        return;
+    }
+
+    // Only draw ahead when D_Display would draw this same view
+    // without a wipe, resize or automap in the way.
+    if (R_SnapshotValid ()
+     && screenvisible
+     && !nodrawers
+     && !automapactive
+     && !setsizeneeded
+     && !wiping
+     && wipegamestate == GS_LEVEL)
+    {
+        kinc_semaphore_signal (&tickerstart);
+        R_RenderSnapshotView ();
+        kinc_semaphore_wait (&tickerdone);
+
+        viewdrawn = true;
+    }
+    else
+    {
+        M_BenchBegin (bench_ticker);
+        P_Ticker ();
+        M_BenchEnd (bench_ticker);
+    }
+
+    R_TakeSnapshot (&players[displayplayer]);
+}
+
 //
 // Add configuration file variable bindings.
 //
@@ -358,6 +482,7 @@ void D_BindVariables(void)
     M_BindVariable("snd_channels",           &snd_channels);
     M_BindVariable("vanilla_savegame_limit", &vanilla_savegame_limit);
     M_BindVariable("vanilla_demo_limit",     &vanilla_demo_limit);
+    M_BindVariable("vanilla_intercepts_overrun", &vanilla_intercepts_overrun);
     M_BindVariable("show_endoom",            &show_endoom);
 
     // Multiplayer chat macros
@@ -455,15 +580,45 @@ void D_DoomFrame(void) {
     // frame syncronous IO operations
     I_StartFrame ();
 
+    // -pipeline draws whole tics ahead
+    fractionaltic = FRACUNIT;
+
     TryRunTics (); // will run at least one tic
 
     S_UpdateSounds (players[consoleplayer].mo);// move positional sounds
 
+    // With -uncapped, start from where the last tic left things;
+    // D_DisplayBetweenTics moves them the rest of the way.
+    if (uncapped)
+        fractionaltic = 0;
+
     // Update display, next frame, with current state.
     if (screenvisible)
     {
         D_Display ();
     }
+
+    fractionaltic = FRACUNIT;
+}
+
+//
+// D_DisplayBetweenTics
+// Called with -uncapped on display frames that run no tic;
+// frac is how far the display is towards the next tic.
+//
+void D_DisplayBetweenTics (fixed_t frac)
+{
+    // wipes and everything but the 3D view advance by tics
+    if (!screenvisible
+     || wiping
+     || gamestate != GS_LEVEL
+     || automapactive
+     || !gametic)
+        return;
+
+    fractionaltic = frac;
+    D_Display ();
+    fractionaltic = FRACUNIT;
 }
 
 //
@@ -1278,6 +1433,25 @@ void D_DoomMain (void)
 
     I_DisplayFPSDots(devparm);
 
+    //!
+    // Draw every display frame, moving things, the view and the
+    // planes smoothly between tics.  The game still runs at 35Hz.
+    //
+
+    uncapped = M_CheckParm ("-uncapped");
+
+    //!
+    // @arg <tics>
+    //
+    // Keep a snapshot of the game every <tics> tics over the last
+    // ten seconds; the rewind key goes back a second at a time.
+    //
+
+    p = M_CheckParmWithArgs ("-rewind", 1);
+
+    if (p)
+        G_InitRewind (atoi (myargv[p+1]));
+
     //!
     // @category net
     // @vanilla
@@ -1777,6 +1951,8 @@ void D_DoomMain (void)
     DEH_printf("R_Init: Init DOOM refresh daemon - ");
     R_Init ();
 
+    D_InitPipeline ();
+
     DEH_printf("\nP_Init: Init Playloop state.\n");
     P_Init ();
 
@@ -1838,6 +2014,14 @@ void D_DoomMain (void)
 		D_DoomLoop ();  // never returns
     }
 
+    // headless benchmark, the frames are driven by the backend
+    if (benchmarking)
+    {
+		G_TimeDemo (M_BenchStart ());
+		D_DoomLoop ();
+		return;
+    }
+
     if (startloadgame >= 0)
     {
         M_StringCopy(file, P_SaveGameFile(startloadgame), sizeof(file));
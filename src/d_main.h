@@ -21,6 +21,7 @@
 #define __D_MAIN__
 
 #include "doomdef.h"
+#include "m_fixed.h"
 
 
 
@@ -28,6 +29,12 @@
 // Read events from all input devices
 
 void D_ProcessEvents (void); 
+
+// Runs P_Ticker, overlapped with drawing the view when pipelining.
+void D_RunTicker (void);
+
+// -uncapped: draws the display between tics.
+void D_DisplayBetweenTics (fixed_t frac);
 	
 
 //
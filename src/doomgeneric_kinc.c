@@ -4,58 +4,186 @@
 //  This is all the kinc-backend-specific code
 //------------------------------------------------------------------------------
 #include "d_event.h"
+#include "d_loop.h"
 #include "doomgeneric.h"
 #include "doomkeys.h"
 #include "i_sound.h"
+#include "i_timer.h"
 #include "i_video.h"
 #include "m_argv.h"
+#include "m_bench.h"
+#include "m_fixed.h"
+#include "s_sound.h"
 #include "sounds.h"
 #include "w_wad.h"
 
 #include <assert.h>
 #include <math.h> // round
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h> // atoi
 #include <string.h>
 
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 #include "kinc/audio2/audio.h"
 #include "kinc/graphics1/graphics.h"
 #include "kinc/input/keyboard.h"
 #include "kinc/input/mouse.h"
 #include "kinc/io/filereader.h"
 #include "kinc/system.h"
+#include "kinc/threads/semaphore.h"
+#include "kinc/threads/thread.h"
+
+// The audio callback must not touch the heap, TinySoundFont allocates
+// through these to count any allocation made on the audio thread.
+static _Thread_local bool on_audio_thread;
+static _Atomic uint32_t audio_thread_allocs;
+
+static void *audio_counted_malloc(size_t size) {
+	if (on_audio_thread) {
+		atomic_fetch_add_explicit(&audio_thread_allocs, 1, memory_order_relaxed);
+	}
+	return malloc(size);
+}
+
+static void *audio_counted_realloc(void *ptr, size_t size) {
+	if (on_audio_thread) {
+		atomic_fetch_add_explicit(&audio_thread_allocs, 1, memory_order_relaxed);
+	}
+	return realloc(ptr, size);
+}
+
+static void audio_counted_free(void *ptr) {
+	if (on_audio_thread && ptr != NULL) {
+		atomic_fetch_add_explicit(&audio_thread_allocs, 1, memory_order_relaxed);
+	}
+	free(ptr);
+}
 
 #define MUS_IMPLEMENTATION
 #include "mus.h"
+#define TSF_MALLOC audio_counted_malloc
+#define TSF_REALLOC audio_counted_realloc
+#define TSF_FREE audio_counted_free
 #define TSF_IMPLEMENTATION
 #include "tsf.h"
 
 // in m_menu.c
 extern boolean menuactive;
+// in d_main.c
+extern boolean uncapped;
 
 void D_DoomMain(void);
 void D_DoomLoop(void);
 void D_DoomFrame(void);
+void D_DisplayBetweenTics(fixed_t frac);
 void dg_Create();
 
-#define KEY_QUEUE_SIZE (32)
+#define KEY_QUEUE_SIZE (32)      // must be a power of two
+#define SND_QUEUE_SIZE (64)      // must be a power of two
+#define MUSIC_QUEUE_SIZE (16)    // must be a power of two
 #define MAXSAMPLECOUNT (4096)
-#define NUM_CHANNELS (8)
+#define MAX_CHANNELS (32)     // upper limit for snd_channels
+#define SND_BLOCK_FRAMES (256) // sound effects are mixed in blocks of this size
 #define MAX_WAD_SIZE (16 * 1024 * 1024)
 #define MAX_SOUNDFONT_SIZE (2 * 1024 * 1024)
+#define MAX_ARGS (64)
+#define MAX_MUSIC_THREADS (8)
+#define DEFAULT_MUSIC_VOICES (64)
+#define MIN_THREADED_VOICES (8) // fewer voices are cheaper to render on one thread
+#define MUS_SAMPLES_PER_SECOND (44100) // see mus_next_event()
+#define RENDER_FRAMES_PER_TIC (MUS_SAMPLES_PER_SECOND / TICRATE)
+
+// Lock-free single-producer/single-consumer ring buffer. Only the producer
+// writes write_index and only the consumer writes read_index, so pushing and
+// popping never block each other. A push into a full ring is dropped and
+// counted instead.
+typedef struct {
+	void *items;
+	uint32_t item_size;
+	uint32_t mask; // capacity - 1
+	_Atomic uint32_t write_index;
+	_Atomic uint32_t read_index;
+	_Atomic uint32_t dropped;
+} spsc_t;
 
 typedef struct {
 	uint8_t key_code;
 	bool pressed;
 } key_state_t;
 
+typedef enum {
+	SND_CMD_START,
+	SND_CMD_STOP,
+	SND_CMD_PARAMS,
+} snd_cmd_type_t;
+
+// channel changes sent from the game thread to the audio thread
+typedef struct {
+	uint8_t type;
+	uint8_t slot;
+	int16_t sfxid;
+	int handle;
+	int leftvol;
+	int rightvol;
+} snd_cmd_t;
+
+typedef enum {
+	SND_INTERP_NONE,
+	SND_INTERP_LINEAR,
+	SND_INTERP_CUBIC,
+} snd_interp_t;
+
 typedef struct {
-	uint8_t *cur_ptr;
-	uint8_t *end_ptr;
+	const uint8_t *data;  // NULL while the channel is free
+	const float *cached;  // -sfxcache: data already at the output rate
+	uint32_t length;      // in samples
+	uint64_t pos;         // 32.32 fixed point sample position
+	uint64_t step;        // added to pos for every output frame
 	int sfxid;
 	int handle;
 	int leftvol;
 	int rightvol;
 } snd_channel_t;
 
+// one MUS event, decoded by mus_compile() when the song is registered
+typedef struct {
+	uint32_t frame;  // output frame from the start of the song
+	uint8_t cmd;     // mus_cmd_t
+	uint8_t channel;
+	uint8_t arg1;    // note, bend amount, system event or controller
+	uint8_t arg2;    // note volume or controller value
+} mus_song_event_t;
+
+typedef struct {
+	mus_song_event_t *events;
+	int num_events;
+	uint32_t num_frames; // length of one pass through the song
+} mus_song_t;
+
+typedef enum {
+	MUSIC_CMD_PLAY,
+	MUSIC_CMD_STOP,
+	MUSIC_CMD_RELEASE, // unregistered, hand the song back to be freed
+} music_cmd_type_t;
+
+// song changes sent from the game thread to the audio thread
+typedef struct {
+	uint8_t type;
+	mus_song_t *song;
+} music_cmd_t;
+
+// -musicthreads: renders every num_threads'th voice into its own buffer
+typedef struct {
+	kinc_thread_t thread;
+	kinc_semaphore_t start;
+	int index;
+	float buffer[MAXSAMPLECOUNT * 2];
+} mus_worker_t;
+
 typedef enum {
 	DATA_STATE_LOADING,
 	DATA_STATE_VALID,
@@ -63,12 +191,19 @@ typedef enum {
 } data_state_t;
 
 static struct {
+	bool headless;            // -bench: no window, no audio device
+	struct {
+		FILE *file;        // -renderaudio, NULL when not rendering
+		int tic;           // gametic rendered up to
+		uint32_t frames;   // written so far
+		uint32_t checksum; // of the written samples
+		double seconds;    // spent mixing
+	} render_audio;
 	uint32_t frames_per_tick; // number of frames per game tick
 	uint32_t frame_tick_counter;
 	struct {
-		key_state_t key_queue[KEY_QUEUE_SIZE];
-		uint32_t key_write_index;
-		uint32_t key_read_index;
+		key_state_t key_items[KEY_QUEUE_SIZE];
+		spsc_t key_queue; // input callbacks -> game
 		uint32_t mouse_button_state;
 		uint32_t delayed_mouse_button_up;
 		bool held_alt;
@@ -77,20 +212,42 @@ static struct {
 	struct {
 		bool use_sfx_prefix;
 		uint16_t cur_sfx_handle;
-		snd_channel_t channels[NUM_CHANNELS];
-		uint32_t resample_outhz;
-		uint32_t resample_inhz;
-		uint32_t resample_accum;
-		int lengths[NUMSFX]; // length in bytes/samples of sound effects
+		snd_cmd_t cmd_items[SND_QUEUE_SIZE];
+		spsc_t cmd_queue; // game -> audio thread
+		int num_channels; // snd_channels, at most MAX_CHANNELS
+		// game thread: handle last started in each slot
+		int started[MAX_CHANNELS];
+		// audio thread: handle of the last sound that ran out in each slot
+		_Atomic int finished[MAX_CHANNELS];
+		// owned by the audio thread, only changed through cmd_queue
+		snd_channel_t channels[MAX_CHANNELS];
+		uint32_t samples_per_second; // output rate
+		snd_interp_t interp;         // -sfxinterp
+		int lengths[NUMSFX];         // length in bytes/samples of sound effects
+		int rates[NUMSFX];           // sample rate of sound effects
+		// -sfxcache: all sound effects resampled to the output rate,
+		// as signed floats in one arena
+		bool use_cache;
+		float *cache;
+		uint32_t cache_offsets[NUMSFX];
+		uint32_t cache_frames[NUMSFX];
 	} sound;
 	struct {
 		tsf *sound_font;
-		void *cur_song_data;
-		int cur_song_len;
 		int volume;
-		mus_t *mus;
+		music_cmd_t cmd_items[MUSIC_QUEUE_SIZE];
+		spsc_t cmd_queue; // game -> audio thread
+		mus_song_t *released_items[MUSIC_QUEUE_SIZE];
+		spsc_t released_queue; // audio thread -> game, songs safe to free
+		// owned by the audio thread, only changed through cmd_queue
+		mus_song_t *song; // playing song
+		int event_index;  // next event of song
+		uint32_t frame;   // position in song
 		bool reset;
-		int leftover;
+		int num_threads;  // 1 unless -musicthreads
+		int render_count; // frames the workers are rendering
+		kinc_semaphore_t render_done;
+		mus_worker_t workers[MAX_MUSIC_THREADS];
 	} music;
 	struct {
 		struct {
@@ -104,12 +261,58 @@ static struct {
 			uint8_t buf[MAX_SOUNDFONT_SIZE];
 		} sf;
 	} data;
+	struct {
+		bool valid;   // rgba holds a conversion of shadow with palette
+		bool pending; // a game frame has run since the last conversion
+		uint32_t palette[256];
+		byte shadow[SCREENWIDTH * SCREENHEIGHT]; // last converted I_VideoBuffer
+		uint32_t rgba[SCREENWIDTH * SCREENHEIGHT];
+	} frame;
 } app;
 
+static void spsc_init(spsc_t *q, void *items, uint32_t item_size, uint32_t capacity) {
+	assert(capacity > 0 && (capacity & (capacity - 1)) == 0);
+	q->items = items;
+	q->item_size = item_size;
+	q->mask = capacity - 1;
+	atomic_init(&q->write_index, 0);
+	atomic_init(&q->read_index, 0);
+	atomic_init(&q->dropped, 0);
+}
+
+// producer side, returns false and counts the item if the ring is full
+static bool spsc_push(spsc_t *q, const void *item) {
+	const uint32_t write_index = atomic_load_explicit(&q->write_index, memory_order_relaxed);
+	const uint32_t read_index = atomic_load_explicit(&q->read_index, memory_order_acquire);
+	if (write_index - read_index > q->mask) {
+		atomic_fetch_add_explicit(&q->dropped, 1, memory_order_relaxed);
+		return false;
+	}
+	memcpy((uint8_t *)q->items + (write_index & q->mask) * q->item_size, item, q->item_size);
+	atomic_store_explicit(&q->write_index, write_index + 1, memory_order_release);
+	return true;
+}
+
+// consumer side, returns false if the ring is empty
+static bool spsc_pop(spsc_t *q, void *item) {
+	const uint32_t read_index = atomic_load_explicit(&q->read_index, memory_order_relaxed);
+	const uint32_t write_index = atomic_load_explicit(&q->write_index, memory_order_acquire);
+	if (read_index == write_index) {
+		return false;
+	}
+	memcpy(item, (uint8_t *)q->items + (read_index & q->mask) * q->item_size, q->item_size);
+	atomic_store_explicit(&q->read_index, read_index + 1, memory_order_release);
+	return true;
+}
+
 static void snd_mix(int, float *);
 static void mus_mix(int, float *);
+static void mus_init_synth(int samples_per_second);
+static void mus_init_threads(void);
+static void run_music_benchmark(char *lumpname);
 static void audio_callback(kinc_a2_buffer_t *buffer, int samples) {
 	const int num_frames = samples / 2;
+	on_audio_thread = true;
 	if (num_frames > 0) {
 		assert(num_frames <= MAXSAMPLECOUNT);
 		snd_mix(num_frames, (float *)buffer->data);
@@ -117,24 +320,86 @@ static void audio_callback(kinc_a2_buffer_t *buffer, int samples) {
 
 		buffer->read_location = 0;
 	}
+	on_audio_thread = false;
 }
 static void update_game_audio(void) {
 	kinc_a2_update();
 }
 
-static void draw_game_frame(void) {
+static void convert_row_scalar(uint32_t *dst, const byte *src, const uint32_t *palette) {
+	for (int i = 0; i < SCREENWIDTH; ++i) {
+		dst[i] = palette[src[i]];
+	}
+}
+
+// built for AVX2 regardless of the compiler flags, only called when the
+// CPU has it
+#if defined(__SSE2__) && (defined(__GNUC__) || defined(__clang__))
+#define HAVE_CONVERT_ROW_AVX2
+__attribute__((target("avx2"))) static void convert_row_avx2(uint32_t *dst, const byte *src, const uint32_t *palette) {
+	int i = 0;
+	// widen 8 palette indices to 32 bits and gather their colors
+	for (; i + 8 <= SCREENWIDTH; i += 8) {
+		__m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(src + i)));
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_i32gather_epi32((const int *)palette, index, 4));
+	}
+	for (; i < SCREENWIDTH; ++i) {
+		dst[i] = palette[src[i]];
+	}
+}
+#endif
+
+static void (*convert_row)(uint32_t *dst, const byte *src, const uint32_t *palette) = convert_row_scalar;
+
+static void init_convert_row(void) {
+#if defined(HAVE_CONVERT_ROW_AVX2)
+	if (__builtin_cpu_supports("avx2")) {
+		convert_row = convert_row_avx2;
+	}
+#endif
+}
 
-	uint32_t *palette = (uint32_t *)I_GetPalette();
-	byte *buffer = I_VideoBuffer;
+// Bring app.frame.rgba up to date with I_VideoBuffer, converting only the
+// rows that changed since the last call. Nothing is touched on display
+// frames without a game frame, unless the palette changed.
+static void convert_game_frame(void) {
+	const uint32_t *palette = (const uint32_t *)I_GetPalette();
+	bool all = !app.frame.valid;
 
-	kinc_g1_begin();
+	if (memcmp(app.frame.palette, palette, sizeof(app.frame.palette)) != 0) {
+		memcpy(app.frame.palette, palette, sizeof(app.frame.palette));
+		all = true;
+	}
+	if (!all && !app.frame.pending) {
+		return;
+	}
 
-	// DRAW SCREEN
-	for (int i = 0; i < SCREENWIDTH * SCREENHEIGHT; ++i) {
-		kinc_internal_g1_image[i] = palette[buffer[i]];
+	for (int y = 0; y < SCREENHEIGHT; ++y) {
+		const byte *src = I_VideoBuffer + y * SCREENWIDTH;
+		byte *shadow = app.frame.shadow + y * SCREENWIDTH;
+
+		if (!all && memcmp(src, shadow, SCREENWIDTH) == 0) {
+			continue;
+		}
+		memcpy(shadow, src, SCREENWIDTH);
+		convert_row(app.frame.rgba + y * SCREENWIDTH, src, app.frame.palette);
 	}
 
-	kinc_g1_end();
+	app.frame.valid = true;
+	app.frame.pending = false;
+}
+
+static void draw_game_frame(void) {
+	M_BenchBegin(bench_blit);
+	convert_game_frame();
+	if (!app.headless) {
+		// the locked texture is not guaranteed to keep its contents,
+		// so the converted frame is copied in every time
+		kinc_g1_begin();
+		memcpy(kinc_internal_g1_image, app.frame.rgba, sizeof(app.frame.rgba));
+		kinc_g1_end();
+	}
+	M_BenchEnd(bench_blit);
 }
 
 void frame(void) {
@@ -159,6 +424,7 @@ void frame(void) {
 		app.frame_tick_counter = 0;
 
 		D_DoomFrame();
+		app.frame.pending = true;
 		// this prevents that very short mouse button taps on touchpads are not deteced
 		if (app.input.delayed_mouse_button_up != 0) {
 			app.input.mouse_button_state &= ~app.input.delayed_mouse_button_up;
@@ -180,28 +446,26 @@ void frame(void) {
 			app.input.wasd_enabled = true;
 		}
 	}
+	else if (uncapped) {
+		// draw the frames in between tics instead of showing the last one again
+		D_DisplayBetweenTics((fixed_t)((int64_t)app.frame_tick_counter * FRACUNIT / app.frames_per_tick));
+		app.frame.pending = true;
+	}
 	update_game_audio();
 	draw_game_frame();
 }
 
 static void push_key(uint8_t key_code, bool pressed) {
 	if (key_code != 0) {
-		assert(app.input.key_write_index < KEY_QUEUE_SIZE);
-		app.input.key_queue[app.input.key_write_index] = (key_state_t){.key_code = key_code, .pressed = pressed};
-		app.input.key_write_index = (app.input.key_write_index + 1) % KEY_QUEUE_SIZE;
+		// a full queue drops the key, see cleanup() for the count
+		spsc_push(&app.input.key_queue, &(key_state_t){.key_code = key_code, .pressed = pressed});
 	}
 }
 
 static key_state_t pull_key(void) {
-	if (app.input.key_read_index == app.input.key_write_index) {
-		return (key_state_t){0};
-	}
-	else {
-		assert(app.input.key_read_index < KEY_QUEUE_SIZE);
-		key_state_t res = app.input.key_queue[app.input.key_read_index];
-		app.input.key_read_index = (app.input.key_read_index + 1) % KEY_QUEUE_SIZE;
-		return res;
-	}
+	key_state_t res = {0};
+	spsc_pop(&app.input.key_queue, &res);
+	return res;
 }
 
 // originally in i_video.c
@@ -394,19 +658,7 @@ void mouse_move(int window, int x, int y, int movement_x, int movement_y) {
 	});
 }
 
-void init(void) {
-	kinc_init("DOOM-Kinc", SCREENWIDTH * 4, SCREENHEIGHT * 4, NULL, NULL);
-	kinc_g1_init(SCREENWIDTH, SCREENHEIGHT);
-	kinc_keyboard_set_key_down_callback(&on_key_down);
-	kinc_keyboard_set_key_up_callback(&on_key_up);
-	kinc_mouse_set_press_callback(&mouse_press);
-	kinc_mouse_set_release_callback(&mouse_release);
-	kinc_mouse_set_move_callback(&mouse_move);
-	kinc_set_background_callback(&on_background);
-
-	kinc_a2_init();
-	kinc_a2_set_callback(&audio_callback);
-
+static void load_data(void) {
 	kinc_file_reader_t reader;
 
 	if (kinc_file_reader_open(&reader, "DOOM1.WAD", KINC_FILE_TYPE_ASSET)) {
@@ -421,6 +673,31 @@ void init(void) {
 		kinc_file_reader_read(&reader, app.data.sf.buf, app.data.sf.size);
 		kinc_file_reader_close(&reader);
 	}
+}
+
+static void init_queues(void) {
+	spsc_init(&app.input.key_queue, app.input.key_items, sizeof(key_state_t), KEY_QUEUE_SIZE);
+	spsc_init(&app.sound.cmd_queue, app.sound.cmd_items, sizeof(snd_cmd_t), SND_QUEUE_SIZE);
+	spsc_init(&app.music.cmd_queue, app.music.cmd_items, sizeof(music_cmd_t), MUSIC_QUEUE_SIZE);
+	spsc_init(&app.music.released_queue, app.music.released_items, sizeof(mus_song_t *), MUSIC_QUEUE_SIZE);
+}
+
+void init(void) {
+	init_queues();
+	init_convert_row();
+	kinc_init("DOOM-Kinc", SCREENWIDTH * 4, SCREENHEIGHT * 4, NULL, NULL);
+	kinc_g1_init(SCREENWIDTH, SCREENHEIGHT);
+	kinc_keyboard_set_key_down_callback(&on_key_down);
+	kinc_keyboard_set_key_up_callback(&on_key_up);
+	kinc_mouse_set_press_callback(&mouse_press);
+	kinc_mouse_set_release_callback(&mouse_release);
+	kinc_mouse_set_move_callback(&mouse_move);
+	kinc_set_background_callback(&on_background);
+
+	kinc_a2_init();
+	kinc_a2_set_callback(&audio_callback);
+
+	load_data();
 
 	kinc_set_update_callback(&frame);
 
@@ -429,7 +706,126 @@ void init(void) {
 	D_DoomMain();
 }
 
+// stereo 32-bit float, the samples are written as they are in memory,
+// so this assumes a little-endian host like the rest of the WAD code
+static void render_audio_write_header(void) {
+	const uint32_t data_size = app.render_audio.frames * 2 * sizeof(float);
+	const uint32_t fields[] = {
+	    0x46464952, 50 + data_size,                      // "RIFF"
+	    0x45564157,                                      // "WAVE"
+	    0x20746d66, 18,                                  // "fmt "
+	    2 << 16 | 3,                                     // stereo, IEEE float
+	    MUS_SAMPLES_PER_SECOND,
+	    MUS_SAMPLES_PER_SECOND * 2 * sizeof(float),
+	    32 << 16 | 2 * sizeof(float),                    // bits, block align
+	};
+	const uint16_t cb_size = 0;
+	const uint32_t fact[] = {0x74636166, 4, app.render_audio.frames}; // "fact"
+	const uint32_t data[] = {0x61746164, data_size};                   // "data"
+	fseek(app.render_audio.file, 0, SEEK_SET);
+	fwrite(fields, sizeof(fields), 1, app.render_audio.file);
+	fwrite(&cb_size, sizeof(cb_size), 1, app.render_audio.file);
+	fwrite(fact, sizeof(fact), 1, app.render_audio.file);
+	fwrite(data, sizeof(data), 1, app.render_audio.file);
+}
+
+static bool render_audio_init(void) {
+
+	//!
+	// @arg <file>
+	// @category demo
+	//
+	// With -bench, mix the sound effects and music of the demos
+	// without an audio device and write them to a WAV file, exactly
+	// 1/35 s per game tic. Prints the mixing throughput and a
+	// checksum of the output.
+	//
+
+	const int p = M_CheckParmWithArgs("-renderaudio", 1);
+	if (p == 0) {
+		return false;
+	}
+	app.render_audio.file = fopen(myargv[p + 1], "wb");
+	if (!app.render_audio.file) {
+		printf("render_audio_init: cannot open %s\n", myargv[p + 1]);
+		return false;
+	}
+	app.render_audio.checksum = 2166136261u;
+	render_audio_write_header();
+	return true;
+}
+
+// mixes and writes the audio of the tics run since the last call
+static void render_audio_tics(void) {
+	static float buffer[RENDER_FRAMES_PER_TIC * 2];
+	if (gametic < app.render_audio.tic) {
+		app.render_audio.tic = gametic;
+	}
+	for (; app.render_audio.tic < gametic; app.render_audio.tic++) {
+		const double start = kinc_time();
+		snd_mix(RENDER_FRAMES_PER_TIC, buffer);
+		mus_mix(RENDER_FRAMES_PER_TIC, buffer);
+		app.render_audio.seconds += kinc_time() - start;
+
+		const uint8_t *bytes = (const uint8_t *)buffer;
+		for (size_t i = 0; i < sizeof(buffer); i++) {
+			app.render_audio.checksum = (app.render_audio.checksum ^ bytes[i]) * 16777619u;
+		}
+		fwrite(buffer, sizeof(buffer), 1, app.render_audio.file);
+		app.render_audio.frames += RENDER_FRAMES_PER_TIC;
+	}
+}
+
+static void render_audio_finish(void) {
+	render_audio_write_header();
+	fclose(app.render_audio.file);
+	app.render_audio.file = NULL;
+
+	const double length = (double)app.render_audio.frames / MUS_SAMPLES_PER_SECOND;
+	printf("render_audio: %u frames (%.1f s) in %.3f s, %.1fx realtime, %.0f frames/s, checksum %08x\n",
+	       app.render_audio.frames, length, app.render_audio.seconds, length / app.render_audio.seconds,
+	       app.render_audio.frames / app.render_audio.seconds, app.render_audio.checksum);
+}
+
+// -bench: play the demo list as fast as possible without window or
+// audio device, one game tic per iteration, then write the report
+static void run_headless(void) {
+	init_queues();
+	init_convert_row();
+	load_data();
+
+	dg_Create();
+	D_DoomMain();
+	app.render_audio.tic = gametic;
+
+	while (!M_BenchFinished()) {
+		M_BenchFrameBegin();
+		D_DoomFrame();
+		app.frame.pending = true;
+		draw_game_frame();
+		M_BenchFrameEnd();
+		if (app.render_audio.file) {
+			render_audio_tics();
+		}
+	}
+	M_BenchWriteReport();
+	if (app.render_audio.file) {
+		render_audio_finish();
+	}
+}
+
 void cleanup(void) {
+	const uint32_t keys_dropped = atomic_load(&app.input.key_queue.dropped);
+	const uint32_t cmds_dropped = atomic_load(&app.sound.cmd_queue.dropped);
+	const uint32_t music_dropped = atomic_load(&app.music.cmd_queue.dropped) + atomic_load(&app.music.released_queue.dropped);
+	if (keys_dropped != 0 || cmds_dropped != 0 || music_dropped != 0) {
+		printf("queue overflows: %u keys, %u sound commands, %u music commands dropped\n", keys_dropped, cmds_dropped,
+		       music_dropped);
+	}
+	const uint32_t audio_allocs = atomic_load(&audio_thread_allocs);
+	if (audio_allocs != 0) {
+		printf("audio thread: %u heap allocations\n", audio_allocs);
+	}
 	// tsf_close(app.music.sound_font);
 	// saudio_shutdown();
 	// sfetch_shutdown();
@@ -438,12 +834,39 @@ void cleanup(void) {
 }
 
 int kickstart(int argc, char *argv[]) {
-	(void)argc;
-	(void)argv;
-	static char *args[] = {"doom", "-iwad", "DOOM1.WAD"};
+	// fixed iwad, followed by the command line arguments
+	static char *args[MAX_ARGS] = {"doom", "-iwad", "DOOM1.WAD"};
 	myargc = 3;
+	for (int i = 1; i < argc && myargc < MAX_ARGS - 1; i++) {
+		args[myargc++] = argv[i];
+	}
 	myargv = args;
 
+	if (M_BenchInit()) {
+		app.headless = true;
+		if (!render_audio_init()) {
+			args[myargc++] = "-nosound";
+		}
+		run_headless();
+		return 0;
+	}
+
+	//!
+	// @arg <lump>
+	//
+	// Render one pass of the given music lump offline as fast as
+	// possible, print the throughput and a checksum of the output,
+	// then quit.
+	//
+
+	int p = M_CheckParmWithArgs("-benchmusic", 1);
+	if (p > 0) {
+		app.headless = true;
+		args[myargc++] = "-nosound";
+		run_music_benchmark(myargv[p + 1]);
+		return 0;
+	}
+
 	init();
 	kinc_start();
 
@@ -458,10 +881,17 @@ int kickstart(int argc, char *argv[]) {
 // in an "own the game loop" scenario, not in a frame-callback scenario.
 
 void DG_Init(void) {
-	// initialize sound font
-	assert(app.data.sf.size > 0);
-	app.music.sound_font = tsf_load_memory(app.data.sf.buf, app.data.sf.size);
-	tsf_set_output(app.music.sound_font, TSF_STEREO_INTERLEAVED, kinc_a2_samples_per_second, 0);
+	if (app.headless) {
+		// no audio device, see -nosound in kickstart(), but
+		// -renderaudio mixes offline at the MUS rate
+		if (app.render_audio.file) {
+			mus_init_synth(MUS_SAMPLES_PER_SECOND);
+			mus_init_threads();
+		}
+		return;
+	}
+	mus_init_synth(kinc_a2_samples_per_second);
+	mus_init_threads();
 }
 
 void DG_DrawFrame(void) {}
@@ -499,6 +929,11 @@ uint32_t DG_GetTicksMs(void) {
 	return 0;
 }
 
+// only used for profiling (see m_bench.c)
+uint64_t DG_GetTicksUs(void) {
+	return (uint64_t)(kinc_time() * 1000000.0);
+}
+
 //== FILE SYSTEM OVERRIDE ======================================================
 #include "m_misc.h"
 #include "memio.h"
@@ -525,7 +960,9 @@ static wad_file_t *memio_OpenFile(char *path) {
 
 	memio_wad_file_t *result = Z_Malloc(sizeof(memio_wad_file_t), PU_STATIC, 0);
 	result->wad.file_class = &memio_wad_file;
-	result->wad.mapped = NULL;
+	// the whole WAD is already resident, so W_CacheLumpNum() can hand out
+	// pointers into the buffer instead of copying lumps into the zone
+	result->wad.mapped = app.data.wad.buf;
 	result->wad.length = app.data.wad.size;
 	result->fstream = fstream;
 
@@ -555,7 +992,7 @@ wad_file_class_t memio_wad_file = {
 // see https://github.com/mattiasgustavsson/doom-crt/blob/main/linuxdoom-1.10/i_sound.c
 
 // helper function to load sound data from WAD lump
-static void *snd_getsfx(const char *sfxname, int *len) {
+static void *snd_getsfx(const char *sfxname, int *len, int *rate) {
 	char name[20];
 	snprintf(name, sizeof(name), "ds%s", sfxname);
 	int sfxlump;
@@ -570,15 +1007,35 @@ static void *snd_getsfx(const char *sfxname, int *len) {
 
 	uint8_t *sfx = W_CacheLumpNum(sfxlump, PU_STATIC);
 	*len = size - 8;
+	// DMX header: format, sample rate, sample count
+	*rate = sfx[2] | sfx[3] << 8;
+	if (*rate == 0) {
+		*rate = 11025;
+	}
 	return sfx + 8;
 }
 
+// Separation, that is, orientation/stereo. range is: 0 - 255
+static void snd_volumes(int volume, int separation, int *leftvol, int *rightvol) {
+	separation += 1;
+
+	// Per left/right channel.
+	//  x^2 seperation,
+	//  adjust volume properly.
+	int left_sep = separation + 1;
+	*leftvol = volume - ((volume * left_sep * left_sep) >> 16);
+	assert((*leftvol >= 0) && (*leftvol <= 127));
+	int right_sep = separation - 256;
+	*rightvol = volume - ((volume * right_sep * right_sep) >> 16);
+	assert((*rightvol >= 0) && (*rightvol <= 127));
+}
+
 // This function adds a sound to the list of currently active sounds,
 // which is maintained as a given number (eight, usually) of internal channels.
 // Returns a handle.
 //
 static int snd_addsfx(int sfxid, int slot, int volume, int separation) {
-	assert((slot >= 0) && (slot < NUM_CHANNELS));
+	assert((slot >= 0) && (slot < app.sound.num_channels));
 	assert((sfxid >= 0) && (sfxid < NUMSFX));
 
 	/* SOKOL CHANGE: this doesn't seem to be necessary unless the
@@ -593,7 +1050,7 @@ static int snd_addsfx(int sfxid, int slot, int volume, int separation) {
 	    (sfxid == sfx_stnmov) ||
 	    (sfxid == sfx_pistol))
 	{
-	    for (int i = 0; i < NUM_CHANNELS; i++) {
+	    for (int i = 0; i < app.sound.num_channels; i++) {
 	        if (app.sound.channels[i].sfxid == sfxid) {
 	            // reset
 	            app.sound.channels[i] = (snd_channel_t){0};
@@ -603,79 +1060,183 @@ static int snd_addsfx(int sfxid, int slot, int volume, int separation) {
 	    }
 	}
 	*/
-	app.sound.channels[slot].sfxid = sfxid;
 	app.sound.cur_sfx_handle += 1;
 	// on wraparound skip the 'invalid handle' 0
 	if (app.sound.cur_sfx_handle == 0) {
 		app.sound.cur_sfx_handle = 1;
 	}
-	app.sound.channels[slot].handle = (int)app.sound.cur_sfx_handle;
-	app.sound.channels[slot].cur_ptr = S_sfx[sfxid].driver_data;
-	app.sound.channels[slot].end_ptr = app.sound.channels[slot].cur_ptr + app.sound.lengths[sfxid];
-
-	// Separation, that is, orientation/stereo. range is: 1 - 256
-	separation += 1;
-
-	// Per left/right channel.
-	//  x^2 seperation,
-	//  adjust volume properly.
-	int left_sep = separation + 1;
-	int leftvol = volume - ((volume * left_sep * left_sep) >> 16);
-	assert((leftvol >= 0) && (leftvol <= 127));
-	int right_sep = separation - 256;
-	int rightvol = volume - ((volume * right_sep * right_sep) >> 16);
-	assert((rightvol >= 0) && (rightvol <= 127));
+	snd_cmd_t cmd = {
+	    .type = SND_CMD_START,
+	    .slot = (uint8_t)slot,
+	    .sfxid = (int16_t)sfxid,
+	    .handle = (int)app.sound.cur_sfx_handle,
+	};
+	snd_volumes(volume, separation, &cmd.leftvol, &cmd.rightvol);
+
+	// a dropped start is a sound that never plays
+	app.sound.started[slot] = spsc_push(&app.sound.cmd_queue, &cmd) ? cmd.handle : 0;
+
+	return cmd.handle;
+}
 
-	app.sound.channels[slot].leftvol = leftvol;
-	app.sound.channels[slot].rightvol = rightvol;
+// apply the channel changes queued by the game thread, audio thread only
+static void snd_apply_commands(void) {
+	snd_cmd_t cmd;
+	while (spsc_pop(&app.sound.cmd_queue, &cmd)) {
+		snd_channel_t *chn = &app.sound.channels[cmd.slot];
+		switch (cmd.type) {
+		case SND_CMD_START:
+			chn->sfxid = cmd.sfxid;
+			chn->handle = cmd.handle;
+			chn->data = S_sfx[cmd.sfxid].driver_data;
+			chn->pos = 0;
+			if (app.sound.cache) {
+				chn->cached = app.sound.cache + app.sound.cache_offsets[cmd.sfxid];
+				chn->length = app.sound.cache_frames[cmd.sfxid];
+				chn->step = (uint64_t)1 << 32;
+			}
+			else {
+				chn->cached = NULL;
+				chn->length = (uint32_t)app.sound.lengths[cmd.sfxid];
+				chn->step = ((uint64_t)app.sound.rates[cmd.sfxid] << 32) / app.sound.samples_per_second;
+			}
+			chn->leftvol = cmd.leftvol;
+			chn->rightvol = cmd.rightvol;
+			break;
+		case SND_CMD_STOP:
+			if (chn->handle == cmd.handle) {
+				*chn = (snd_channel_t){0};
+			}
+			break;
+		case SND_CMD_PARAMS:
+			if (chn->handle == cmd.handle) {
+				chn->leftvol = cmd.leftvol;
+				chn->rightvol = cmd.rightvol;
+			}
+			break;
+		}
+	}
+}
 
-	return app.sound.channels[slot].handle;
+// Resamples up to num_frames of a channel to the output rate as signed
+// samples, returns fewer frames if the sound effect ends.
+static int snd_resample(snd_channel_t *chn, float *out, int num_frames) {
+	const uint8_t *data = chn->data;
+	const uint64_t end = (uint64_t)chn->length << 32;
+	const uint32_t last = chn->length - 1;
+	const uint64_t step = chn->step;
+	uint64_t pos = chn->pos;
+	// frames left before pos runs past the end
+	const uint64_t left = (end - pos + step - 1) / step;
+	const int count = left < (uint64_t)num_frames ? (int)left : num_frames;
+	int i = 0;
+	switch (app.sound.interp) {
+	case SND_INTERP_NONE:
+		for (; i < count; i++, pos += step) {
+			out[i] = (float)data[pos >> 32] - 128.0f;
+		}
+		break;
+	case SND_INTERP_LINEAR:
+		for (; i < count; i++, pos += step) {
+			const uint32_t index = (uint32_t)(pos >> 32);
+			const float frac = (float)(uint32_t)pos * (1.0f / 4294967296.0f);
+			const float s0 = data[index];
+			const float s1 = data[index < last ? index + 1 : last];
+			out[i] = s0 + (s1 - s0) * frac - 128.0f;
+		}
+		break;
+	case SND_INTERP_CUBIC:
+		for (; i < count; i++, pos += step) {
+			const uint32_t index = (uint32_t)(pos >> 32);
+			const float frac = (float)(uint32_t)pos * (1.0f / 4294967296.0f);
+			const float s0 = data[index > 0 ? index - 1 : 0];
+			const float s1 = data[index];
+			const float s2 = data[index < last ? index + 1 : last];
+			const float s3 = data[index + 1 < last ? index + 2 : last];
+			// Catmull-Rom spline from s1 to s2
+			out[i] = s1 + 0.5f * frac * (s2 - s0 + frac * (2.0f * s0 - 5.0f * s1 + 4.0f * s2 - s3 + frac * (3.0f * (s1 - s2) + s3 - s0))) - 128.0f;
+		}
+		break;
+	}
+	chn->pos = pos;
+	return count;
 }
 
-static float snd_clampf(float val, float maxval, float minval) {
-	if (val > maxval) {
-		return maxval;
+// left/right += mono * volume
+static void snd_accumulate(float *left, float *right, const float *mono, int num_frames, float leftvol, float rightvol) {
+	int i = 0;
+#if defined(__SSE2__)
+	const __m128 lv = _mm_set1_ps(leftvol);
+	const __m128 rv = _mm_set1_ps(rightvol);
+	for (; i + 4 <= num_frames; i += 4) {
+		const __m128 m = _mm_loadu_ps(mono + i);
+		_mm_storeu_ps(left + i, _mm_add_ps(_mm_loadu_ps(left + i), _mm_mul_ps(m, lv)));
+		_mm_storeu_ps(right + i, _mm_add_ps(_mm_loadu_ps(right + i), _mm_mul_ps(m, rv)));
 	}
-	else if (val < minval) {
-		return minval;
+#endif
+	for (; i < num_frames; i++) {
+		left[i] += mono[i] * leftvol;
+		right[i] += mono[i] * rightvol;
 	}
-	else {
-		return val;
+}
+
+// buffer = interleaved, scaled and clamped left/right
+static void snd_store(float *buffer, const float *left, const float *right, int num_frames) {
+	const float scale = 1.0f / 16383.0f;
+	int i = 0;
+#if defined(__SSE2__)
+	const __m128 s = _mm_set1_ps(scale);
+	const __m128 lo = _mm_set1_ps(-1.0f);
+	const __m128 hi = _mm_set1_ps(1.0f);
+	for (; i + 4 <= num_frames; i += 4) {
+		const __m128 l = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(left + i), s), lo), hi);
+		const __m128 r = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(right + i), s), lo), hi);
+		_mm_storeu_ps(buffer + i * 2, _mm_unpacklo_ps(l, r));
+		_mm_storeu_ps(buffer + i * 2 + 4, _mm_unpackhi_ps(l, r));
+	}
+#endif
+	for (; i < num_frames; i++) {
+		buffer[i * 2] = fminf(fmaxf(left[i] * scale, -1.0f), 1.0f);
+		buffer[i * 2 + 1] = fminf(fmaxf(right[i] * scale, -1.0f), 1.0f);
 	}
 }
 
-// mix active sound channels into the mixing buffer
+// mix active sound channels into the mixing buffer, each channel steps
+// through its sound effect at its own rate
 static void snd_mix(int num_frames, float *buffer) {
-
-	float cur_left_sample = 0.0f;
-	float cur_right_sample = 0.0f;
-
-	for (int frame_index = 0; frame_index < num_frames; frame_index++) {
-		// downsampling: compute new left/right sample?
-		if (app.sound.resample_accum >= app.sound.resample_outhz) {
-			app.sound.resample_accum -= app.sound.resample_outhz;
-			int dl = 0;
-			int dr = 0;
-			for (int slot = 0; slot < NUM_CHANNELS; slot++) {
-				snd_channel_t *chn = &app.sound.channels[slot];
-				if (chn->cur_ptr) {
-					int sample = ((int)(*chn->cur_ptr++)) - 128;
-					dl += sample * chn->leftvol;
-					dr += sample * chn->rightvol;
-					// sound effect done?
-					if (chn->cur_ptr >= chn->end_ptr) {
-						*chn = (snd_channel_t){0};
-					}
-				}
+	float left[SND_BLOCK_FRAMES];
+	float right[SND_BLOCK_FRAMES];
+	float mono[SND_BLOCK_FRAMES];
+
+	snd_apply_commands();
+
+	for (int offset = 0; offset < num_frames; offset += SND_BLOCK_FRAMES) {
+		const int block_frames = num_frames - offset < SND_BLOCK_FRAMES ? num_frames - offset : SND_BLOCK_FRAMES;
+		memset(left, 0, block_frames * sizeof(float));
+		memset(right, 0, block_frames * sizeof(float));
+		for (int slot = 0; slot < app.sound.num_channels; slot++) {
+			snd_channel_t *chn = &app.sound.channels[slot];
+			if (!chn->data) {
+				continue;
+			}
+			int count;
+			if (chn->cached) {
+				const uint32_t index = (uint32_t)(chn->pos >> 32);
+				count = chn->length - index < (uint32_t)block_frames ? (int)(chn->length - index) : block_frames;
+				snd_accumulate(left, right, chn->cached + index, count, (float)chn->leftvol, (float)chn->rightvol);
+				chn->pos += (uint64_t)count << 32;
+			}
+			else {
+				count = snd_resample(chn, mono, block_frames);
+				snd_accumulate(left, right, mono, count, (float)chn->leftvol, (float)chn->rightvol);
+			}
+			// sound effect done?
+			if (count < block_frames) {
+				atomic_store_explicit(&app.sound.finished[slot], chn->handle, memory_order_release);
+				*chn = (snd_channel_t){0};
 			}
-			cur_left_sample = snd_clampf(((float)dl) / 16383.0f, 1.0f, -1.0f);
-			cur_right_sample = snd_clampf(((float)dr) / 16383.0f, 1.0f, -1.0f);
 		}
-		app.sound.resample_accum += app.sound.resample_inhz;
-
-		// write left and right sample values to mix buffer
-		buffer[frame_index * 2] = cur_left_sample;
-		buffer[frame_index * 2 + 1] = cur_right_sample;
+		snd_store(buffer + offset * 2, left, right, block_frames);
 	}
 }
 
@@ -683,8 +1244,43 @@ static boolean snd_Init(boolean use_sfx_prefix) {
 	assert(use_sfx_prefix);
 	app.sound.use_sfx_prefix = use_sfx_prefix;
 	assert(app.sound.use_sfx_prefix);
-	app.sound.resample_outhz = app.sound.resample_accum = kinc_a2_samples_per_second;
-	app.sound.resample_inhz = 11025; // sound effect are in 11025Hz
+	app.sound.samples_per_second = app.headless ? MUS_SAMPLES_PER_SECOND : kinc_a2_samples_per_second;
+
+	// the game picks the slot of each sound out of snd_channels
+	if (snd_channels > MAX_CHANNELS) {
+		snd_channels = MAX_CHANNELS;
+	}
+	app.sound.num_channels = snd_channels;
+
+	//!
+	// @arg <mode>
+	//
+	// Interpolation of sound effects when resampling them to the
+	// output rate: none (default), linear or cubic.
+	//
+
+	app.sound.interp = SND_INTERP_NONE;
+	const int p = M_CheckParmWithArgs("-sfxinterp", 1);
+	if (p > 0) {
+		if (!strcmp(myargv[p + 1], "linear")) {
+			app.sound.interp = SND_INTERP_LINEAR;
+		}
+		else if (!strcmp(myargv[p + 1], "cubic")) {
+			app.sound.interp = SND_INTERP_CUBIC;
+		}
+		else if (strcmp(myargv[p + 1], "none")) {
+			printf("snd_Init: unknown -sfxinterp %s, using none\n", myargv[p + 1]);
+		}
+	}
+
+	//!
+	// Resample all sound effects to the output rate at startup and
+	// keep them as floats, so mixing them is only a multiply-add.
+	// Uses about 16 times the memory of the sound effect lumps at
+	// 44.1 kHz.
+	//
+
+	app.sound.use_cache = M_CheckParm("-sfxcache") > 0;
 	return true;
 }
 
@@ -708,7 +1304,13 @@ static void snd_Update(void) {
 }
 
 static void snd_UpdateSoundParams(int handle, int vol, int sep) {
-	// FIXME
+	for (int i = 0; i < app.sound.num_channels; i++) {
+		if (app.sound.started[i] == handle) {
+			snd_cmd_t cmd = {.type = SND_CMD_PARAMS, .slot = (uint8_t)i, .handle = handle};
+			snd_volumes(vol, sep, &cmd.leftvol, &cmd.rightvol);
+			spsc_push(&app.sound.cmd_queue, &cmd);
+		}
+	}
 }
 
 // Starts a sound in a particular sound channel.
@@ -732,27 +1334,71 @@ static int snd_StartSound(sfxinfo_t *sfxinfo, int channel, int vol, int sep) {
 }
 
 static void snd_StopSound(int handle) {
-	for (int i = 0; i < NUM_CHANNELS; i++) {
-		if (app.sound.channels[i].handle == handle) {
-			app.sound.channels[i] = (snd_channel_t){0};
+	for (int i = 0; i < app.sound.num_channels; i++) {
+		if (app.sound.started[i] == handle) {
+			spsc_push(&app.sound.cmd_queue, &(snd_cmd_t){.type = SND_CMD_STOP, .slot = (uint8_t)i, .handle = handle});
+			app.sound.started[i] = 0;
 		}
 	}
 }
 
+// a sound plays from its start command until the audio thread reports it
+// finished, or until it is stopped or replaced in its slot
 static boolean snd_SoundIsPlaying(int handle) {
-	for (int i = 0; i < NUM_CHANNELS; i++) {
-		if (app.sound.channels[i].handle == handle) {
-			return true;
+	for (int i = 0; i < app.sound.num_channels; i++) {
+		if (handle != 0 && app.sound.started[i] == handle) {
+			return atomic_load_explicit(&app.sound.finished[i], memory_order_acquire) != handle;
 		}
 	}
 	return false;
 }
 
+// Frames of a sound effect at the output rate.
+static uint32_t snd_output_frames(int sfxid) {
+	const uint64_t step = ((uint64_t)app.sound.rates[sfxid] << 32) / app.sound.samples_per_second;
+	return (uint32_t)((((uint64_t)app.sound.lengths[sfxid] << 32) + step - 1) / step);
+}
+
+// -sfxcache: resample every loaded sound effect once into a single
+// arena, linked sounds share the entry of the sound they link to.
+static void snd_build_cache(sfxinfo_t *sounds, int num_sounds) {
+	size_t total = 0;
+	for (int i = 0; i < num_sounds; i++) {
+		if (0 == sounds[i].link && sounds[i].driver_data) {
+			app.sound.cache_offsets[i] = (uint32_t)total;
+			app.sound.cache_frames[i] = snd_output_frames(i);
+			total += app.sound.cache_frames[i];
+		}
+	}
+	float *cache = malloc(total * sizeof(float));
+	if (!cache) {
+		printf("snd_build_cache: cannot allocate %zu frames, mixing from the lumps\n", total);
+		return;
+	}
+	for (int i = 0; i < num_sounds; i++) {
+		if (0 == sounds[i].link && sounds[i].driver_data) {
+			snd_channel_t chn = {
+			    .data = sounds[i].driver_data,
+			    .length = (uint32_t)app.sound.lengths[i],
+			    .step = ((uint64_t)app.sound.rates[i] << 32) / app.sound.samples_per_second,
+			};
+			snd_resample(&chn, cache + app.sound.cache_offsets[i], (int)app.sound.cache_frames[i]);
+		}
+		else if (sounds[i].link) {
+			const int snd_index = sounds[i].link - sounds;
+			app.sound.cache_offsets[i] = app.sound.cache_offsets[snd_index];
+			app.sound.cache_frames[i] = app.sound.cache_frames[snd_index];
+		}
+	}
+	app.sound.cache = cache;
+	printf("snd_build_cache: %zu KiB for %zu frames\n", total * sizeof(float) / 1024, total);
+}
+
 static void snd_CacheSounds(sfxinfo_t *sounds, int num_sounds) {
 	for (int i = 0; i < num_sounds; i++) {
 		if (0 == sounds[i].link) {
 			// load data from WAD file
-			sounds[i].driver_data = snd_getsfx(sounds[i].name, &app.sound.lengths[i]);
+			sounds[i].driver_data = snd_getsfx(sounds[i].name, &app.sound.lengths[i], &app.sound.rates[i]);
 		}
 		else {
 			// previously loaded already?
@@ -760,8 +1406,12 @@ static void snd_CacheSounds(sfxinfo_t *sounds, int num_sounds) {
 			assert((snd_index >= 0) && (snd_index < NUMSFX));
 			sounds[i].driver_data = sounds[i].link->driver_data;
 			app.sound.lengths[i] = app.sound.lengths[snd_index];
+			app.sound.rates[i] = app.sound.rates[snd_index];
 		}
 	}
+	if (app.sound.use_cache) {
+		snd_build_cache(sounds, num_sounds);
+	}
 }
 
 static snddevice_t sound_kinc_devices[] = {
@@ -784,10 +1434,245 @@ sound_module_t sound_kinc_module = {
 
 /*== MUSIC SUPPORT ===========================================================*/
 
+static void mus_worker(void *param) {
+	mus_worker_t *worker = param;
+	on_audio_thread = true;
+	for (;;) {
+		kinc_semaphore_wait(&worker->start);
+		const int count = app.music.render_count;
+		memset(worker->buffer, 0, count * 2 * sizeof(float));
+		tsf_render_float_voices(app.music.sound_font, worker->buffer, count, worker->index, app.music.num_threads);
+		kinc_semaphore_signal(&app.music.render_done);
+	}
+}
+
+static void mus_init_threads(void) {
+	app.music.num_threads = 1;
+
+	//!
+	// @arg <n>
+	//
+	// Render music voices on n threads (default 1). The voices are
+	// summed in a different order, so the output is not bit-identical
+	// to rendering on one thread.
+	//
+
+	int p = M_CheckParmWithArgs("-musicthreads", 1);
+	if (p == 0) {
+		return;
+	}
+	int num_threads = atoi(myargv[p + 1]);
+	if (num_threads < 1) {
+		num_threads = 1;
+	}
+	if (num_threads > MAX_MUSIC_THREADS) {
+		num_threads = MAX_MUSIC_THREADS;
+	}
+	app.music.num_threads = num_threads;
+	if (num_threads == 1) {
+		return;
+	}
+	kinc_semaphore_init(&app.music.render_done, 0, num_threads);
+	for (int i = 1; i < num_threads; i++) {
+		mus_worker_t *worker = &app.music.workers[i];
+		worker->index = i;
+		kinc_semaphore_init(&worker->start, 0, 1);
+		kinc_thread_init(&worker->thread, mus_worker, worker);
+	}
+	printf("mus_init_threads: rendering music on %i threads\n", num_threads);
+}
+
+// mixes count frames of all playing voices into output
+static void mus_render(tsf *sf, float *output, int count) {
+	const int num_threads = app.music.num_threads;
+	if (num_threads == 1 || tsf_active_voice_count(sf) < MIN_THREADED_VOICES) {
+		tsf_render_float(sf, output, count, 1);
+		return;
+	}
+	app.music.render_count = count;
+	for (int i = 1; i < num_threads; i++) {
+		kinc_semaphore_signal(&app.music.workers[i].start);
+	}
+	tsf_render_float_voices(sf, output, count, 0, num_threads);
+	for (int i = 1; i < num_threads; i++) {
+		kinc_semaphore_wait(&app.music.render_done);
+	}
+	for (int i = 1; i < num_threads; i++) {
+		const float *src = app.music.workers[i].buffer;
+		for (int j = 0; j < count * 2; j++) {
+			output[j] += src[j];
+		}
+	}
+}
+
+// pre-decodes a MUS lump, returns NULL if it is not a playable song
+static mus_song_t *mus_compile(void *data, int len) {
+	mus_t *mus = mus_create(data, len, 0);
+	if (!mus) {
+		return NULL;
+	}
+	mus_song_t *song = calloc(1, sizeof(mus_song_t));
+	int max_events = 0;
+	uint32_t frame = 0;
+	for (;;) {
+		mus_event_t ev;
+		mus_next_event(mus, &ev);
+		if (ev.cmd == MUS_CMD_FINISH) {
+			break;
+		}
+		if (ev.cmd == MUS_CMD_RENDER_SAMPLES) {
+			frame += ev.data.render_samples.samples_count;
+			continue;
+		}
+		if (ev.cmd == MUS_CMD_END_OF_MEASURE) {
+			continue;
+		}
+		if (song->num_events == max_events) {
+			max_events = max_events ? max_events * 2 : 256;
+			song->events = realloc(song->events, max_events * sizeof(mus_song_event_t));
+		}
+		mus_song_event_t *out = &song->events[song->num_events++];
+		out->frame = frame;
+		out->cmd = (uint8_t)ev.cmd;
+		out->channel = (uint8_t)ev.channel;
+		out->arg1 = 0;
+		out->arg2 = 0;
+		switch (ev.cmd) {
+		case MUS_CMD_RELEASE_NOTE:
+			out->arg1 = ev.data.release_note.note;
+			break;
+		case MUS_CMD_PLAY_NOTE:
+			out->arg1 = ev.data.play_note.note;
+			out->arg2 = ev.data.play_note.volume;
+			break;
+		case MUS_CMD_PITCH_BEND:
+			out->arg1 = ev.data.pitch_bend.bend_amount;
+			break;
+		case MUS_CMD_SYSTEM_EVENT:
+			out->arg1 = ev.data.system_event.event;
+			break;
+		case MUS_CMD_CONTROLLER:
+			out->arg1 = ev.data.controller.controller;
+			out->arg2 = ev.data.controller.value;
+			break;
+		default:
+			break;
+		}
+	}
+	mus_destroy(mus);
+	song->num_frames = frame;
+	// a song without delays would loop forever within one callback
+	if (song->num_frames == 0) {
+		free(song->events);
+		free(song);
+		return NULL;
+	}
+	return song;
+}
+
+static void mus_free_song(mus_song_t *song) {
+	free(song->events);
+	free(song);
+}
+
+static void mus_apply_event(tsf *sf, const mus_song_event_t *ev) {
+	switch (ev->cmd) {
+	case MUS_CMD_RELEASE_NOTE:
+		tsf_channel_note_off(sf, ev->channel, ev->arg1);
+		break;
+	case MUS_CMD_PLAY_NOTE:
+		tsf_channel_note_on(sf, ev->channel, ev->arg1, ev->arg2 / 127.0f);
+		break;
+	case MUS_CMD_PITCH_BEND: {
+		int pitch_bend = (ev->arg1 - 128) * 64 + 8192;
+		tsf_channel_set_pitchwheel(sf, ev->channel, pitch_bend);
+	} break;
+	case MUS_CMD_SYSTEM_EVENT:
+		switch (ev->arg1) {
+		case MUS_SYSTEM_EVENT_ALL_SOUNDS_OFF:
+			tsf_channel_sounds_off_all(sf, ev->channel);
+			break;
+		case MUS_SYSTEM_EVENT_ALL_NOTES_OFF:
+			tsf_channel_note_off_all(sf, ev->channel);
+			break;
+		case MUS_SYSTEM_EVENT_MONO:
+		case MUS_SYSTEM_EVENT_POLY:
+			// not supported
+			break;
+		case MUS_SYSTEM_EVENT_RESET_ALL_CONTROLLERS:
+			tsf_channel_midi_control(sf, ev->channel, 121, 0);
+			break;
+		}
+		break;
+	case MUS_CMD_CONTROLLER: {
+		int value = ev->arg2;
+		switch (ev->arg1) {
+		case MUS_CONTROLLER_CHANGE_INSTRUMENT:
+			if (ev->channel == 15) {
+				tsf_channel_set_presetnumber(sf, 15, 0, 1);
+			}
+			else {
+				tsf_channel_set_presetnumber(sf, ev->channel, value, 0);
+			}
+			break;
+		case MUS_CONTROLLER_BANK_SELECT:
+			tsf_channel_set_bank(sf, ev->channel, value);
+			break;
+		case MUS_CONTROLLER_VOLUME:
+			tsf_channel_midi_control(sf, ev->channel, 7, value);
+			break;
+		case MUS_CONTROLLER_PAN:
+			tsf_channel_midi_control(sf, ev->channel, 10, value);
+			break;
+		case MUS_CONTROLLER_EXPRESSION:
+			tsf_channel_midi_control(sf, ev->channel, 11, value);
+			break;
+		case MUS_CONTROLLER_MODULATION:
+		case MUS_CONTROLLER_REVERB_DEPTH:
+		case MUS_CONTROLLER_CHORUS_DEPTH:
+		case MUS_CONTROLLER_SUSTAIN_PEDAL:
+		case MUS_CONTROLLER_SOFT_PEDAL:
+			break;
+		}
+	} break;
+	default:
+		break;
+	}
+}
+
+// apply the song changes queued by the game thread, audio thread only
+static void mus_apply_commands(void) {
+	music_cmd_t cmd;
+	while (spsc_pop(&app.music.cmd_queue, &cmd)) {
+		switch (cmd.type) {
+		case MUSIC_CMD_PLAY:
+			app.music.song = cmd.song;
+			app.music.event_index = 0;
+			app.music.frame = 0;
+			app.music.reset = true;
+			break;
+		case MUSIC_CMD_STOP:
+			app.music.song = NULL;
+			app.music.reset = true;
+			break;
+		case MUSIC_CMD_RELEASE:
+			if (app.music.song == cmd.song) {
+				app.music.song = NULL;
+			}
+			// a dropped song is leaked, it can't be freed safely
+			spsc_push(&app.music.released_queue, &cmd.song);
+			break;
+		}
+	}
+}
+
 // see: https://github.com/mattiasgustavsson/doom-crt/blob/f5108fe122fa9c2a334a0ae387d36ddbabc5bf1a/linuxdoom-1.10/i_sound.c#L576
+// Events are applied at their frame and the voices are rendered in one
+// piece up to the next event, or the end of the buffer.
 static void mus_mix(int num_frames, float *buffer) {
-	mus_t *mus = app.music.mus;
-	if (!mus) {
+	mus_apply_commands();
+	const mus_song_t *song = app.music.song;
+	if (!song) {
 		return;
 	}
 	tsf *sf = app.music.sound_font;
@@ -797,119 +1682,73 @@ static void mus_mix(int num_frames, float *buffer) {
 		app.music.reset = false;
 	}
 	tsf_set_volume(sf, app.music.volume);
-	int leftover_from_previous = app.music.leftover;
+	const mus_song_event_t *events = song->events;
+	int index = app.music.event_index;
+	uint32_t frame = app.music.frame;
 	int remaining = num_frames;
 	float *output = buffer;
-	int leftover = 0;
-	if (leftover_from_previous > 0) {
-		int count = leftover_from_previous;
+	while (remaining > 0) {
+		while (index < song->num_events && events[index].frame == frame) {
+			mus_apply_event(sf, &events[index++]);
+		}
+		if (frame >= song->num_frames) {
+			// always looping
+			index = 0;
+			frame = 0;
+			continue;
+		}
+		const uint32_t next = index < song->num_events ? events[index].frame : song->num_frames;
+		int count = (int)(next - frame);
 		if (count > remaining) {
-			leftover = count - remaining;
 			count = remaining;
 		}
-		tsf_render_float(sf, output, count, 1);
+		mus_render(sf, output, count);
+		frame += count;
 		remaining -= count;
 		output += count * 2;
 	}
-	if (leftover > 0) {
-		app.music.leftover = leftover;
-		return;
-	}
+	app.music.event_index = index;
+	app.music.frame = frame;
+}
 
-	while (remaining) {
-		mus_event_t ev;
-		mus_next_event(app.music.mus, &ev);
-		switch (ev.cmd) {
-		case MUS_CMD_RELEASE_NOTE:
-			tsf_channel_note_off(sf, ev.channel, ev.data.release_note.note);
-			break;
-		case MUS_CMD_PLAY_NOTE:
-			tsf_channel_note_on(sf, ev.channel, ev.data.play_note.note, ev.data.play_note.volume / 127.0f);
-			break;
-		case MUS_CMD_PITCH_BEND: {
-			int pitch_bend = (ev.data.pitch_bend.bend_amount - 128) * 64 + 8192;
-			tsf_channel_set_pitchwheel(sf, ev.channel, pitch_bend);
-		} break;
-		case MUS_CMD_SYSTEM_EVENT:
-			switch (ev.data.system_event.event) {
-			case MUS_SYSTEM_EVENT_ALL_SOUNDS_OFF:
-				tsf_channel_sounds_off_all(sf, ev.channel);
-				break;
-			case MUS_SYSTEM_EVENT_ALL_NOTES_OFF:
-				tsf_channel_note_off_all(sf, ev.channel);
-				break;
-			case MUS_SYSTEM_EVENT_MONO:
-			case MUS_SYSTEM_EVENT_POLY:
-				// not supported
-				break;
-			case MUS_SYSTEM_EVENT_RESET_ALL_CONTROLLERS:
-				tsf_channel_midi_control(sf, ev.channel, 121, 0);
-				break;
-			}
-			break;
-		case MUS_CMD_CONTROLLER: {
-			int value = ev.data.controller.value;
-			switch (ev.data.controller.controller) {
-			case MUS_CONTROLLER_CHANGE_INSTRUMENT:
-				if (ev.channel == 15) {
-					tsf_channel_set_presetnumber(sf, 15, 0, 1);
-				}
-				else {
-					tsf_channel_set_presetnumber(sf, ev.channel, value, 0);
-				}
-				break;
-			case MUS_CONTROLLER_BANK_SELECT:
-				tsf_channel_set_bank(sf, ev.channel, value);
-				break;
-			case MUS_CONTROLLER_VOLUME:
-				tsf_channel_midi_control(sf, ev.channel, 7, value);
-				break;
-			case MUS_CONTROLLER_PAN:
-				tsf_channel_midi_control(sf, ev.channel, 10, value);
-				break;
-			case MUS_CONTROLLER_EXPRESSION:
-				tsf_channel_midi_control(sf, ev.channel, 11, value);
-				break;
-			case MUS_CONTROLLER_MODULATION:
-			case MUS_CONTROLLER_REVERB_DEPTH:
-			case MUS_CONTROLLER_CHORUS_DEPTH:
-			case MUS_CONTROLLER_SUSTAIN_PEDAL:
-			case MUS_CONTROLLER_SOFT_PEDAL:
-				break;
-			}
-		} break;
-		case MUS_CMD_END_OF_MEASURE:
-			// not used
-			break;
-		case MUS_CMD_FINISH:
-			mus_restart(mus);
-			break;
-		case MUS_CMD_RENDER_SAMPLES: {
-			int count = ev.data.render_samples.samples_count;
-			if (count > remaining) {
-				leftover = count - remaining;
-				count = remaining;
-			}
-			tsf_render_float(sf, output, count, 1);
-			remaining -= count;
-			output += count * 2;
-		} break;
+static void mus_init_synth(int samples_per_second) {
+	// initialize sound font
+	assert(app.data.sf.size > 0);
+	app.music.sound_font = tsf_load_memory(app.data.sf.buf, app.data.sf.size);
+	tsf_set_output(app.music.sound_font, TSF_STEREO_INTERLEAVED, samples_per_second, 0);
+
+	//!
+	// @arg <n>
+	//
+	// Play at most n music voices at once (default 64). When all are
+	// playing, a new note takes over the quietest released voice or
+	// else the oldest voice.
+	//
+
+	int max_voices = DEFAULT_MUSIC_VOICES;
+	int p = M_CheckParmWithArgs("-musicvoices", 1);
+	if (p > 0) {
+		max_voices = atoi(myargv[p + 1]);
+		if (max_voices < 1) {
+			max_voices = 1;
 		}
 	}
-	app.music.leftover = leftover;
+
+	// everything the audio thread renders into is allocated here: the
+	// voice pool, and all 16 MUS channels (channels are allocated up to
+	// the highest one used)
+	tsf_set_max_voices(app.music.sound_font, max_voices);
+	tsf_set_voice_stealing(app.music.sound_font, 1);
+	tsf_channel_set_bank(app.music.sound_font, 15, 0);
 }
 
 static boolean mus_Init(void) {
-	app.music.reset = true;
 	app.music.volume = 7;
 	return true;
 }
 
 static void mus_Shutdown(void) {
-	if (app.music.mus) {
-		mus_destroy(app.music.mus);
-		app.music.mus = 0;
-	}
+	spsc_push(&app.music.cmd_queue, &(music_cmd_t){.type = MUSIC_CMD_STOP});
 }
 
 static void mus_SetMusicVolume(int volume) {
@@ -925,35 +1764,24 @@ static void mus_ResumeMusic(void) {
 }
 
 static void *mus_RegisterSong(void *data, int len) {
-	app.music.cur_song_data = data;
-	app.music.cur_song_len = len;
-	return 0;
+	return mus_compile(data, len);
 }
 
+// The song is freed by mus_Poll() once the audio thread has let go of it.
 static void mus_UnRegisterSong(void *handle) {
-	app.music.cur_song_data = 0;
-	app.music.cur_song_len = 0;
+	if (handle == NULL) {
+		return;
+	}
+	// a dropped release is a leaked song
+	spsc_push(&app.music.cmd_queue, &(music_cmd_t){.type = MUSIC_CMD_RELEASE, .song = handle});
 }
 
 static void mus_PlaySong(void *handle, boolean looping) {
-	if (app.music.mus) {
-		mus_destroy(app.music.mus);
-		app.music.mus = 0;
-	}
-	assert(app.music.cur_song_data);
-	assert(app.music.cur_song_len == *(((uint16_t *)app.music.cur_song_data) + 2) + *(((uint16_t *)app.music.cur_song_data) + 3));
-	app.music.mus = mus_create(app.music.cur_song_data, app.music.cur_song_len, 0);
-	assert(app.music.mus);
-	app.music.leftover = 0;
-	app.music.reset = true;
+	spsc_push(&app.music.cmd_queue, &(music_cmd_t){.type = MUSIC_CMD_PLAY, .song = handle});
 }
 
 static void mus_StopSong(void) {
-	assert(app.music.mus);
-	mus_destroy(app.music.mus);
-	app.music.mus = 0;
-	app.music.leftover = 0;
-	app.music.reset = true;
+	spsc_push(&app.music.cmd_queue, &(music_cmd_t){.type = MUSIC_CMD_STOP});
 }
 
 static boolean mus_MusicIsPlaying(void) {
@@ -961,8 +1789,13 @@ static boolean mus_MusicIsPlaying(void) {
 	return false;
 }
 
+// frees the songs the audio thread handed back, see update_game_audio()
+// for the mixing
 static void mus_Poll(void) {
-	// empty, see update_game_audio() instead
+	mus_song_t *song;
+	while (spsc_pop(&app.music.released_queue, &song)) {
+		mus_free_song(song);
+	}
 }
 
 static snddevice_t music_kinc_devices[] = {
@@ -984,3 +1817,63 @@ music_module_t music_kinc_module = {
     .MusicIsPlaying = mus_MusicIsPlaying,
     .Poll = mus_Poll,
 };
+
+// -benchmusic: the song is rendered through mus_mix() in audio callback
+// sized pieces, only the mixing is timed
+static void run_music_benchmark(char *lumpname) {
+	static float buffer[MAXSAMPLECOUNT * 2];
+
+	init_queues();
+	load_data();
+	Z_Init();
+	W_AddFile("DOOM1.WAD");
+
+	const int lump = W_CheckNumForName(lumpname);
+	if (lump < 0) {
+		printf("run_music_benchmark: no lump %s\n", lumpname);
+		return;
+	}
+	mus_song_t *song = mus_RegisterSong(W_CacheLumpNum(lump, PU_STATIC), W_LumpLength(lump));
+	if (!song) {
+		printf("run_music_benchmark: %s is not a MUS song\n", lumpname);
+		return;
+	}
+
+	mus_init_synth(MUS_SAMPLES_PER_SECOND);
+	mus_init_threads();
+	mus_Init();
+	app.music.volume = 1;
+	mus_PlaySong(song, true);
+
+	uint32_t checksum = 2166136261u;
+	double seconds = 0;
+	int peak_voices = 0;
+	for (uint32_t frame = 0; frame < song->num_frames;) {
+		int count = MAXSAMPLECOUNT / 4;
+		if ((uint32_t)count > song->num_frames - frame) {
+			count = (int)(song->num_frames - frame);
+		}
+		memset(buffer, 0, count * 2 * sizeof(float));
+		const double start = kinc_time();
+		mus_mix(count, buffer);
+		seconds += kinc_time() - start;
+		frame += count;
+
+		const int voices = tsf_active_voice_count(app.music.sound_font);
+		if (voices > peak_voices) {
+			peak_voices = voices;
+		}
+		const uint8_t *bytes = (const uint8_t *)buffer;
+		for (size_t i = 0; i < count * 2 * sizeof(float); i++) {
+			checksum = (checksum ^ bytes[i]) * 16777619u;
+		}
+	}
+
+	const double length = (double)song->num_frames / MUS_SAMPLES_PER_SECOND;
+	printf("run_music_benchmark: %s, %u frames (%.1f s) in %.3f s, %.1fx realtime, %.0f frames/s, peak %i voices, checksum %08x\n",
+	       lumpname, song->num_frames, length, seconds, length / seconds, song->num_frames / seconds, peak_voices, checksum);
+	mus_UnRegisterSong(song);
+	// hand the song back and free it
+	mus_mix(0, buffer);
+	mus_Poll();
+}
@@ -48,6 +48,7 @@ extern  boolean	respawnparm;	// checkparm of -respawn
 extern  boolean	fastparm;	// checkparm of -fast
 
 extern  boolean	devparm;	// DEBUG: launched with -devparm
+extern  boolean	uncapped;	// checkparm of -uncapped
 
 
 // -----------------------------------------------------
@@ -274,6 +275,7 @@ extern int		skyflatnum;
 
 
 extern	int		rndindex;
+extern	int		prndindex;	// playsim random index, for snapshots
 
 extern  ticcmd_t       *netcmds;
 
@@ -31,6 +31,7 @@
 #include "z_zone.h"
 #include "f_finale.h"
 #include "m_argv.h"
+#include "m_bench.h"
 #include "m_controls.h"
 #include "m_misc.h"
 #include "m_menu.h"
@@ -73,8 +74,6 @@
 #include "g_game.h"
 
 
-#define SAVEGAMESIZE	0x2c000
-
 void	G_ReadDemoTiccmd (ticcmd_t* cmd); 
 void	G_WriteDemoTiccmd (ticcmd_t* cmd); 
 void	G_PlayerReborn (int player); 
@@ -88,6 +87,7 @@ void	G_DoCompleted (void);
 void	G_DoVictory (void); 
 void	G_DoWorldDone (void); 
 void	G_DoSaveGame (void); 
+void	G_DoRewind (void); 
  
 // Gamestate the last time G_Ticker was called.
 
@@ -148,6 +148,16 @@ int             testcontrols_mousespeed;
 wbstartstruct_t wminfo;               	// parms for world map / intermission 
  
 byte		consistancy[MAXPLAYERS][BACKUPTICS]; 
+
+// Snapshots for rewinding, taken every rewindtics tics
+// over the last REWINDSECONDS seconds.
+#define REWINDSECONDS	10
+
+static gamesnapshot_t*	rewindsnapshots;
+static int		numrewindsnapshots;
+static int		rewindtics;
+static int		rewindhead;		// next slot to write
+static int		rewindcount;
  
 #define MAXPLMOVE		(forwardmove[1]) 
  
@@ -653,6 +663,7 @@ void G_DoLoadLevel (void)
     } 
 		 
     P_SetupLevel (gameepisode, gamemap, 0, gameskill);    
+    rewindcount = 0;				// snapshots of the last level
     displayplayer = consoleplayer;		// view the guy you are playing    
     gameaction = ga_nothing; 
     Z_CheckHeap ();
@@ -732,6 +743,15 @@ static void SetMouseButtons(unsigned int buttons_mask)
 // 
 boolean G_Responder (event_t* ev) 
 { 
+    if (gamestate == GS_LEVEL && ev->type == ev_keydown
+     && ev->data1 == key_rewind && rewindcount > 0
+     && gameaction == ga_nothing
+     && !demoplayback && !demorecording && !netgame)
+    {
+	gameaction = ga_rewind;
+	return true;
+    }
+
     // allow spy mode changes even during the demo
     if (gamestate == GS_LEVEL && ev->type == ev_keydown 
      && ev->data1 == key_spy && (singledemo || !deathmatch) )
@@ -879,6 +899,9 @@ void G_Ticker (void)
 	  case ga_savegame: 
 	    G_DoSaveGame (); 
 	    break; 
+	  case ga_rewind: 
+	    G_DoRewind (); 
+	    break; 
 	  case ga_playdemo: 
 	    G_DoPlayDemo (); 
 	    break; 
@@ -1005,7 +1028,8 @@ void G_Ticker (void)
     switch (gamestate) 
     { 
       case GS_LEVEL: 
-	P_Ticker (); 
+	D_RunTicker (); 
+	G_RecordRewind (); 
 	ST_Ticker (); 
 	AM_Ticker (); 
 	HU_Ticker ();            
@@ -1635,6 +1659,140 @@ void G_DoSaveGame (void)
 	R_FillBackScreen();
 }
 
+//
+// G_SaveSnapshot
+// Serializes the game state in memory, as a savegame would.
+//
+void G_SaveSnapshot (gamesnapshot_t* snap)
+{
+    P_OpenSaveBufferForWriting ();
+
+    P_ArchivePlayers ();
+    P_ArchiveWorld ();
+    P_ArchiveThinkers ();
+    P_ArchiveSpecials ();
+    P_ArchiveSnapshot ();
+
+    P_WriteSaveGameEOF ();
+
+    P_CloseSaveBufferForWriting (&snap->buffer);
+
+    snap->gameepisode = gameepisode;
+    snap->gamemap = gamemap;
+    snap->leveltime = leveltime;
+    snap->rndindex = rndindex;
+    snap->prndindex = prndindex;
+}
+
+
+//
+// G_LoadSnapshot
+// Restores a snapshot of the current level in place,
+// without setting the level up again.
+//
+boolean G_LoadSnapshot (gamesnapshot_t* snap)
+{
+    if (gamestate != GS_LEVEL
+     || snap->gameepisode != gameepisode
+     || snap->gamemap != gamemap)
+    {
+	return false;
+    }
+
+    P_OpenSaveBufferForReading (&snap->buffer);
+
+    savegame_error = false;
+
+    P_UnArchivePlayers ();
+    P_UnArchiveWorld ();
+    P_UnArchiveThinkers ();
+    P_UnArchiveSpecials ();
+    P_UnArchiveSnapshot ();
+
+    if (!P_ReadSaveGameEOF ())
+	I_Error ("Bad snapshot");
+
+    P_CloseSaveBufferForReading ();
+
+    leveltime = snap->leveltime;
+    rndindex = snap->rndindex;
+    prndindex = snap->prndindex;
+
+    return true;
+}
+
+
+//
+// G_InitRewind
+// Snapshots are kept every tics tics, 0 disables rewinding.
+//
+void G_InitRewind (int tics)
+{
+    if (tics <= 0)
+	return;
+
+    rewindtics = tics;
+    numrewindsnapshots = (REWINDSECONDS * TICRATE + tics - 1) / tics;
+    rewindsnapshots = calloc (numrewindsnapshots, sizeof(*rewindsnapshots));
+
+    if (rewindsnapshots == NULL)
+	I_Error ("G_InitRewind: failed to allocate %i snapshots",
+		 numrewindsnapshots);
+}
+
+
+//
+// G_RecordRewind
+// Called after every level tic.
+//
+void G_RecordRewind (void)
+{
+    if (!rewindtics || leveltime % rewindtics)
+	return;
+
+    M_BenchBegin (bench_snapshot);
+    G_SaveSnapshot (&rewindsnapshots[rewindhead]);
+    M_BenchEnd (bench_snapshot);
+
+    rewindhead = (rewindhead + 1) % numrewindsnapshots;
+
+    if (rewindcount < numrewindsnapshots)
+	rewindcount++;
+}
+
+
+//
+// G_DoRewind
+// Goes back to the newest snapshot at least a second old,
+// or the oldest one there is.  Newer snapshots are dropped.
+//
+void G_DoRewind (void)
+{
+    gamesnapshot_t*	snap;
+
+    gameaction = ga_nothing;
+
+    for (;;)
+    {
+	rewindhead = (rewindhead + numrewindsnapshots - 1) % numrewindsnapshots;
+	rewindcount--;
+	snap = &rewindsnapshots[rewindhead];
+
+	if (rewindcount == 0 || leveltime - snap->leveltime >= TICRATE)
+	    break;
+    }
+
+    // keep the one rewound to, the next rewind goes further back
+    rewindhead = (rewindhead + 1) % numrewindsnapshots;
+    rewindcount++;
+
+    if (!G_LoadSnapshot (snap))
+	return;
+
+    players[consoleplayer].message = "Rewound";
+}
+
+
 //
 // G_InitNew
 // Can be called by the startup code or the menu task,
@@ -2159,6 +2317,7 @@ void G_DoPlayDemo (void)
     G_InitNew (skill, episode, map); 
     precache = true; 
     starttime = I_GetTime (); 
+    M_BenchDemoStart (defdemoname, gametic);
 
     usergame = false; 
     demoplayback = true; 
@@ -2212,6 +2371,33 @@ boolean G_CheckDemoStatus (void)
         timingdemo = false;
         demoplayback = false;
 
+        // With -bench, go on with the next demo in the list instead
+        // of exiting; the report is written once the list is done.
+        if (benchmarking)
+        {
+            char *nextdemo;
+
+            M_BenchDemoEnd (gametic);
+            W_ReleaseLumpName (defdemoname);
+            netdemo = false;
+            netgame = false;
+            deathmatch = false;
+            playeringame[1] = playeringame[2] = playeringame[3] = 0;
+            respawnparm = false;
+            fastparm = false;
+            nomonsters = false;
+            consoleplayer = 0;
+
+            nextdemo = M_BenchNextDemo ();
+
+            if (nextdemo != NULL)
+            {
+                G_TimeDemo (nextdemo);
+            }
+
+            return true;
+        }
+
 	I_Error ("timed %i gametics in %i realtics (%f fps)",
                  gametic, realtics, fps);
     } 
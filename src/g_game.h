@@ -23,6 +23,7 @@
 #include "doomdef.h"
 #include "d_event.h"
 #include "d_ticcmd.h"
+#include "p_saveg.h"
 
 
 //
@@ -48,6 +49,24 @@ void G_DoLoadGame (void);
 // Called by M_Responder.
 void G_SaveGame (int slot, char* description);
 
+// In-memory snapshot of the game state on the current level.
+typedef struct
+{
+    savebuffer_t	buffer;
+    int			gameepisode;
+    int			gamemap;
+    int			leveltime;
+    int			rndindex;
+    int			prndindex;
+} gamesnapshot_t;
+
+void G_SaveSnapshot (gamesnapshot_t* snap);
+boolean G_LoadSnapshot (gamesnapshot_t* snap);
+
+// Keep snapshots every tics tics to rewind to.
+void G_InitRewind (int tics);
+void G_RecordRewind (void);
+
 // Only called by startup code.
 void G_RecordDemo (char* name);
 
@@ -163,6 +163,25 @@ byte *I_ZoneBase (int *size)
     return zonemem;
 }
 
+//
+// I_Realloc
+// realloc() that errors out instead of returning NULL.
+//
+void *I_Realloc(void *ptr, size_t size)
+{
+    void *new_ptr;
+
+    new_ptr = realloc(ptr, size);
+
+    if (size != 0 && new_ptr == NULL)
+    {
+        I_Error ("I_Realloc: failed on reallocation of %lu bytes",
+                 (unsigned long) size);
+    }
+
+    return new_ptr;
+}
+
 void I_PrintBanner(char *msg)
 {
     int i;
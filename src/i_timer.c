@@ -70,6 +70,16 @@ int I_GetTimeMS(void)
     return ticks - basetime;
 }
 
+//
+// High resolution timestamp in microseconds, for profiling.
+// Unlike the above this is not relative to the first call.
+//
+
+uint64_t I_GetTimeUS(void)
+{
+    return DG_GetTicksUs();
+}
+
 // Sleep for a specified number of ms
 
 void I_Sleep(int ms)
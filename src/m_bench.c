@@ -0,0 +1,589 @@
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Headless demo benchmark.
+//	Plays a list of demo lumps back to back in -timedemo mode,
+//	records the time spent in each section of every tic and
+//	writes min/max/percentiles as JSON.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "i_system.h"
+#include "i_timer.h"
+#include "m_argv.h"
+#include "p_local.h"
+#include "r_main.h"
+#include "r_things.h"
+#include "w_wad.h"
+#include "z_zone.h"
+
+#include "m_bench.h"
+
+// Total tic time is stored after the individual sections.
+#define BENCH_TOTAL             NUMBENCHSECTIONS
+#define NUMBENCHCOLUMNS         (NUMBENCHSECTIONS + 1)
+
+// Histogram of total tic time, bucket i counts [2^i, 2^(i+1)) us.
+#define NUMBENCHBUCKETS         24
+
+typedef struct
+{
+    uint32_t us[NUMBENCHCOLUMNS];
+} benchsample_t;
+
+typedef struct
+{
+    char *name;
+    int firstsample;
+    int numsamples;
+    int starttic;
+    int endtic;
+    uint64_t starttime;
+    uint64_t endtime;
+    zonestats_t zonestart;
+    zonestats_t zoneend;
+    renderusage_t peakusage;
+    unsigned int sighthits;
+    unsigned int sightmisses;
+} benchdemo_t;
+
+static const char *section_names[NUMBENCHCOLUMNS] =
+{
+    "ticker", "bsp", "planes", "masked", "draw", "blit", "snapshot",
+    "thinkers", "total",
+};
+
+boolean benchmarking = false;
+
+static char *reportfile = "bench.json";
+
+static benchdemo_t *demos;
+static int numdemos;
+static int curdemo = -1;
+static boolean finished;
+
+static benchsample_t *samples;
+static int numsamples;
+static int maxsamples;
+
+// Per-tic accumulation.
+static benchsample_t cursample;
+static uint64_t sectionstart[NUMBENCHSECTIONS];
+static uint64_t framestart;
+static boolean demoactive;
+static boolean framevalid;
+
+//
+// M_BenchInit
+//
+
+boolean M_BenchInit(void)
+{
+    int p;
+    int i;
+
+    //!
+    // @arg <demo1> [<demo2> ...]
+    // @category demo
+    //
+    // Run without a window, play back the given demo lumps one after
+    // the other as fast as possible and write per-tic timings to a
+    // report file (see -benchreport).
+    //
+
+    //!
+    // @category demo
+    //
+    // Time the vissprite sort against the original selection sort
+    // for a range of sprite counts, print the results and quit.
+    //
+
+    if (M_CheckParm("-benchsort"))
+    {
+        R_BenchSortVisSprites();
+        exit(0);
+    }
+
+    p = M_CheckParmWithArgs("-bench", 1);
+
+    if (!p)
+    {
+        return false;
+    }
+
+    demos = malloc(sizeof(*demos) * myargc);
+    numdemos = 0;
+
+    for (i = p + 1; i < myargc && myargv[i][0] != '-'; ++i)
+    {
+        memset(&demos[numdemos], 0, sizeof(*demos));
+        demos[numdemos].name = myargv[i];
+        ++numdemos;
+    }
+
+    //!
+    // @arg <file>
+    // @category demo
+    //
+    // File to write the -bench report to, "-" for stdout.
+    // Defaults to bench.json.
+    //
+
+    p = M_CheckParmWithArgs("-benchreport", 1);
+
+    if (p)
+    {
+        reportfile = myargv[p + 1];
+    }
+
+    benchmarking = true;
+
+    return true;
+}
+
+char *M_BenchStart(void)
+{
+    int i;
+
+    if (numdemos == 0)
+    {
+        I_Error("M_BenchStart: no demo lumps given to -bench");
+    }
+
+    for (i = 0; i < numdemos; ++i)
+    {
+        if (W_CheckNumForName(demos[i].name) < 0)
+        {
+            I_Error("M_BenchStart: demo lump '%s' not found", demos[i].name);
+        }
+    }
+
+    curdemo = -1;
+
+    return M_BenchNextDemo();
+}
+
+char *M_BenchNextDemo(void)
+{
+    if (curdemo + 1 >= numdemos)
+    {
+        finished = true;
+        return NULL;
+    }
+
+    ++curdemo;
+
+    return demos[curdemo].name;
+}
+
+boolean M_BenchFinished(void)
+{
+    return finished;
+}
+
+//
+// Demo boundaries. The tic in which a demo starts (level load) and
+// the tic in which it ends are not recorded.
+//
+
+void M_BenchDemoStart(char *name, int tic)
+{
+    benchdemo_t *demo;
+
+    if (!benchmarking || curdemo < 0)
+    {
+        return;
+    }
+
+    demo = &demos[curdemo];
+    demo->name = name;
+    demo->firstsample = numsamples;
+    demo->numsamples = 0;
+    demo->starttic = tic;
+    demo->starttime = I_GetTimeUS();
+    Z_GetStats(&demo->zonestart);
+    memset(&peakusage, 0, sizeof(peakusage));
+    demo->sighthits = sightcachehits;
+    demo->sightmisses = sightcachemisses;
+
+    demoactive = true;
+}
+
+void M_BenchDemoEnd(int tic)
+{
+    benchdemo_t *demo;
+
+    if (!benchmarking || curdemo < 0)
+    {
+        return;
+    }
+
+    demo = &demos[curdemo];
+    demo->endtic = tic;
+    demo->endtime = I_GetTimeUS();
+    Z_GetStats(&demo->zoneend);
+    demo->peakusage = peakusage;
+    demo->sighthits = sightcachehits - demo->sighthits;
+    demo->sightmisses = sightcachemisses - demo->sightmisses;
+
+    printf("M_Bench: %s: %i gametics, %i samples\n",
+           demo->name, demo->endtic - demo->starttic, demo->numsamples);
+
+    demoactive = false;
+}
+
+//
+// Per-tic timing
+//
+
+void M_BenchFrameBegin(void)
+{
+    if (!benchmarking)
+    {
+        return;
+    }
+
+    memset(&cursample, 0, sizeof(cursample));
+    framevalid = demoactive;
+    framestart = I_GetTimeUS();
+}
+
+void M_BenchFrameEnd(void)
+{
+    if (!benchmarking)
+    {
+        return;
+    }
+
+    if (!framevalid || !demoactive)
+    {
+        return;
+    }
+
+    cursample.us[BENCH_TOTAL] = (uint32_t) (I_GetTimeUS() - framestart);
+
+    if (numsamples >= maxsamples)
+    {
+        maxsamples = maxsamples ? maxsamples * 2 : 4096;
+        samples = realloc(samples, sizeof(*samples) * maxsamples);
+
+        if (samples == NULL)
+        {
+            I_Error("M_BenchFrameEnd: failed to grow sample buffer");
+        }
+    }
+
+    samples[numsamples++] = cursample;
+    ++demos[curdemo].numsamples;
+}
+
+void M_BenchBegin(benchsection_t section)
+{
+    if (benchmarking)
+    {
+        sectionstart[section] = I_GetTimeUS();
+    }
+}
+
+void M_BenchEnd(benchsection_t section)
+{
+    if (benchmarking)
+    {
+        cursample.us[section] +=
+            (uint32_t) (I_GetTimeUS() - sectionstart[section]);
+    }
+}
+
+//
+// Report
+//
+
+static int CompareU32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *) a;
+    uint32_t y = *(const uint32_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of a sorted array.
+
+static uint32_t Percentile(uint32_t *sorted, int count, int pct)
+{
+    int rank;
+
+    rank = (count * pct + 99) / 100;
+
+    if (rank < 1)
+    {
+        rank = 1;
+    }
+
+    return sorted[rank - 1];
+}
+
+static void WriteSection(FILE *stream, uint32_t *values, int count)
+{
+    uint64_t sum;
+    int i;
+
+    if (count == 0)
+    {
+        fprintf(stream, "null");
+        return;
+    }
+
+    qsort(values, count, sizeof(*values), CompareU32);
+
+    sum = 0;
+
+    for (i = 0; i < count; ++i)
+    {
+        sum += values[i];
+    }
+
+    fprintf(stream,
+            "{ \"min\": %u, \"max\": %u, \"mean\": %.1f, "
+            "\"p50\": %u, \"p95\": %u, \"p99\": %u }",
+            values[0], values[count - 1], (double) sum / count,
+            Percentile(values, count, 50),
+            Percentile(values, count, 95),
+            Percentile(values, count, 99));
+}
+
+static void WriteHistogram(FILE *stream, benchsample_t *s, int count)
+{
+    int buckets[NUMBENCHBUCKETS];
+    int last;
+    int i, b;
+
+    memset(buckets, 0, sizeof(buckets));
+
+    for (i = 0; i < count; ++i)
+    {
+        uint32_t us = s[i].us[BENCH_TOTAL];
+
+        for (b = 0; b < NUMBENCHBUCKETS - 1 && us >= (2u << b); ++b);
+
+        ++buckets[b];
+    }
+
+    last = 0;
+
+    for (b = 0; b < NUMBENCHBUCKETS; ++b)
+    {
+        if (buckets[b] != 0)
+        {
+            last = b;
+        }
+    }
+
+    fprintf(stream, "{ \"bucket_us\": [");
+
+    for (b = 0; b <= last; ++b)
+    {
+        fprintf(stream, "%s%u", b ? ", " : "", b ? 1u << b : 0u);
+    }
+
+    fprintf(stream, "], \"counts\": [");
+
+    for (b = 0; b <= last; ++b)
+    {
+        fprintf(stream, "%s%i", b ? ", " : "", buckets[b]);
+    }
+
+    fprintf(stream, "] }");
+}
+
+// Zone allocator activity between two counter snapshots.
+
+static void WriteZoneStats(FILE *stream, zonestats_t *start,
+                           zonestats_t *end, int tics, char *indent)
+{
+    uint64_t mallocs = end->mallocs - start->mallocs;
+    uint64_t visited = end->visited - start->visited;
+
+    fprintf(stream, "%s\"zone\": { \"mallocs\": %llu, \"frees\": %llu, "
+                    "\"purges\": %llu, \"bytes\": %llu, \"visited\": %llu, "
+                    "\"mallocs_per_tic\": %.2f, \"visited_per_malloc\": %.2f, "
+                    "\"pool_allocs\": %llu, \"pool_frees\": %llu, \"slabs\": %llu },\n",
+            indent,
+            (unsigned long long) mallocs,
+            (unsigned long long) (end->frees - start->frees),
+            (unsigned long long) (end->purges - start->purges),
+            (unsigned long long) (end->bytes - start->bytes),
+            (unsigned long long) visited,
+            tics ? (double) mallocs / tics : 0.0,
+            mallocs ? (double) visited / mallocs : 0.0,
+            (unsigned long long) (end->poolallocs - start->poolallocs),
+            (unsigned long long) (end->poolfrees - start->poolfrees),
+            (unsigned long long) (end->slabs - start->slabs));
+}
+
+// Highest renderer pool usage in any one frame.
+
+static void WriteRenderPeaks(FILE *stream, renderusage_t *peak, char *indent)
+{
+    fprintf(stream, "%s\"render_peak\": { \"visplanes\": %i, "
+                    "\"drawsegs\": %i, \"vissprites\": %i, "
+                    "\"openings\": %i },\n",
+            indent, peak->visplanes, peak->drawsegs, peak->vissprites,
+            peak->openings);
+}
+
+// P_CheckSight memo use; misses are the full BSP traversals.
+
+static void WriteSightStats(FILE *stream, unsigned int hits,
+                            unsigned int misses, char *indent)
+{
+    fprintf(stream, "%s\"sight_cache\": { \"hits\": %u, \"misses\": %u, "
+                    "\"hit_rate\": %.3f },\n",
+            indent, hits, misses,
+            hits + misses ? (double) hits / (hits + misses) : 0.0);
+}
+
+static void WriteStats(FILE *stream, benchsample_t *s, int count,
+                       char *indent)
+{
+    uint32_t *values;
+    int col;
+    int i;
+
+    values = malloc(sizeof(*values) * (count > 0 ? count : 1));
+
+    fprintf(stream, "%s\"sections\": {\n", indent);
+
+    for (col = 0; col < NUMBENCHCOLUMNS; ++col)
+    {
+        for (i = 0; i < count; ++i)
+        {
+            values[i] = s[i].us[col];
+        }
+
+        fprintf(stream, "%s  \"%s\": ", indent, section_names[col]);
+        WriteSection(stream, values, count);
+        fprintf(stream, "%s\n", col < NUMBENCHCOLUMNS - 1 ? "," : "");
+    }
+
+    fprintf(stream, "%s},\n", indent);
+    fprintf(stream, "%s\"histogram\": ", indent);
+    WriteHistogram(stream, s, count);
+    fprintf(stream, "\n");
+
+    free(values);
+}
+
+void M_BenchWriteReport(void)
+{
+    FILE *stream;
+    zonestats_t zone;
+    renderusage_t peak;
+    uint64_t totaltime;
+    unsigned int sighthits;
+    unsigned int sightmisses;
+    int totaltics;
+    int i;
+
+    if (!benchmarking)
+    {
+        return;
+    }
+
+    if (!strcmp(reportfile, "-"))
+    {
+        stream = stdout;
+    }
+    else
+    {
+        stream = fopen(reportfile, "w");
+
+        if (stream == NULL)
+        {
+            I_Error("M_BenchWriteReport: unable to open '%s'", reportfile);
+        }
+    }
+
+    totaltime = 0;
+    totaltics = 0;
+    sighthits = 0;
+    sightmisses = 0;
+    memset(&peak, 0, sizeof(peak));
+
+    Z_GetStats(&zone);
+
+    fprintf(stream, "{\n  \"unit\": \"us\",\n");
+    fprintf(stream, "  \"zone_allocator\": \"%s\",\n", zone.allocator);
+    fprintf(stream, "  \"thinker_order\": \"%s\",\n",
+            thinkerbuckets ? "buckets" : "vanilla");
+    fprintf(stream, "  \"demos\": [\n");
+
+    for (i = 0; i < numdemos; ++i)
+    {
+        benchdemo_t *demo = &demos[i];
+        uint64_t elapsed = demo->endtime - demo->starttime;
+        int tics = demo->endtic - demo->starttic;
+
+        totaltime += elapsed;
+        totaltics += tics;
+        sighthits += demo->sighthits;
+        sightmisses += demo->sightmisses;
+
+        if (demo->peakusage.visplanes > peak.visplanes)
+            peak.visplanes = demo->peakusage.visplanes;
+        if (demo->peakusage.drawsegs > peak.drawsegs)
+            peak.drawsegs = demo->peakusage.drawsegs;
+        if (demo->peakusage.vissprites > peak.vissprites)
+            peak.vissprites = demo->peakusage.vissprites;
+        if (demo->peakusage.openings > peak.openings)
+            peak.openings = demo->peakusage.openings;
+
+        fprintf(stream, "    {\n");
+        fprintf(stream, "      \"name\": \"%s\",\n", demo->name);
+        fprintf(stream, "      \"gametics\": %i,\n", tics);
+        fprintf(stream, "      \"samples\": %i,\n", demo->numsamples);
+        fprintf(stream, "      \"elapsed_us\": %llu,\n",
+                (unsigned long long) elapsed);
+        fprintf(stream, "      \"fps\": %.2f,\n",
+                elapsed ? tics * 1000000.0 / elapsed : 0.0);
+        WriteZoneStats(stream, &demo->zonestart, &demo->zoneend, tics,
+                       "      ");
+        WriteRenderPeaks(stream, &demo->peakusage, "      ");
+        WriteSightStats(stream, demo->sighthits, demo->sightmisses,
+                        "      ");
+        WriteStats(stream, samples + demo->firstsample, demo->numsamples,
+                   "      ");
+        fprintf(stream, "    }%s\n", i < numdemos - 1 ? "," : "");
+    }
+
+    fprintf(stream, "  ],\n  \"overall\": {\n");
+    fprintf(stream, "    \"gametics\": %i,\n", totaltics);
+    fprintf(stream, "    \"samples\": %i,\n", numsamples);
+    fprintf(stream, "    \"elapsed_us\": %llu,\n",
+            (unsigned long long) totaltime);
+    fprintf(stream, "    \"fps\": %.2f,\n",
+            totaltime ? totaltics * 1000000.0 / totaltime : 0.0);
+    WriteZoneStats(stream, &demos[0].zonestart, &demos[numdemos - 1].zoneend,
+                   totaltics, "    ");
+    WriteRenderPeaks(stream, &peak, "    ");
+    WriteSightStats(stream, sighthits, sightmisses, "    ");
+    WriteStats(stream, samples, numsamples, "    ");
+    fprintf(stream, "  }\n}\n");
+
+    if (stream != stdout)
+    {
+        fclose(stream);
+        printf("M_Bench: report written to %s\n", reportfile);
+    }
+}
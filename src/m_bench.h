@@ -0,0 +1,63 @@
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Headless demo benchmark: per-tic section timings and report.
+//
+
+
+#ifndef __M_BENCH__
+#define __M_BENCH__
+
+#include "doomtype.h"
+
+// Timed sections of a single tic.
+typedef enum
+{
+    bench_ticker,       // P_Ticker
+    bench_bsp,          // R_RenderBSPNode
+    bench_planes,       // R_DrawPlanes
+    bench_masked,       // R_DrawMasked
+    bench_draw,         // queued drawing with -renderthreads
+    bench_blit,         // palette conversion of the finished frame
+    bench_snapshot,     // G_SaveSnapshot with -rewind
+    bench_thinkers,     // P_RunThinkers, part of bench_ticker
+
+    NUMBENCHSECTIONS
+} benchsection_t;
+
+// True when running with -bench.
+extern boolean benchmarking;
+
+// Parse -bench / -benchreport; returns true if a benchmark was requested.
+boolean M_BenchInit(void);
+
+// Checks that all requested demo lumps exist, returns the first one.
+char *M_BenchStart(void);
+
+// Next demo lump to play, or NULL when the list is exhausted.
+char *M_BenchNextDemo(void);
+
+void M_BenchDemoStart(char *name, int tic);
+void M_BenchDemoEnd(int tic);
+
+void M_BenchFrameBegin(void);
+void M_BenchFrameEnd(void);
+
+void M_BenchBegin(benchsection_t section);
+void M_BenchEnd(benchsection_t section);
+
+// True once the last demo in the list has finished.
+boolean M_BenchFinished(void);
+
+void M_BenchWriteReport(void);
+
+#endif
@@ -855,6 +855,17 @@ static default_t extra_defaults_list[] =
 
     CONFIG_VARIABLE_INT(vanilla_demo_limit),
 
+    //!
+    // @game doom
+    //
+    // If non-zero, hitscan traces that cross more than 128 lines
+    // and things overwrite the same variables they did in Vanilla
+    // Doom, as some demos depend on.  If this has a value of zero,
+    // such traces leave other variables alone.
+    //
+
+    CONFIG_VARIABLE_INT(vanilla_intercepts_overrun),
+
     //!
     // If non-zero, the game behaves like Vanilla Doom, always assuming
     // an American keyboard mapping.  If this has a value of zero, the
@@ -1262,6 +1273,12 @@ static default_t extra_defaults_list[] =
 
     CONFIG_VARIABLE_KEY(key_spy),
 
+    //!
+    // Keyboard shortcut to go back a second, with -rewind.
+    //
+
+    CONFIG_VARIABLE_KEY(key_rewind),
+
     //!
     // Keyboard shortcut to increase the screen size.
     //
@@ -78,6 +78,7 @@ extern int key_arti_invulnerability;
 
 extern int key_demo_quit;
 extern int key_spy;
+extern int key_rewind;
 extern int key_prevweapon;
 extern int key_nextweapon;
 
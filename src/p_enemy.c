@@ -21,6 +21,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "m_bbox.h"
 #include "m_random.h"
 #include "i_system.h"
 
@@ -817,6 +818,8 @@ void A_SPosAttack (mobj_t* actor)
     S_StartSound (actor, sfx_shotgn);
     A_FaceTarget (actor);
     bangle = actor->angle;
+
+    P_BeginTraverseBatch (actor->x, actor->y);
     slope = P_AimLineAttack (actor, bangle, MISSILERANGE);
 
     for (i=0 ; i<3 ; i++)
@@ -825,6 +828,8 @@ void A_SPosAttack (mobj_t* actor)
 	damage = ((P_Random()%5)+1)*3;
 	P_LineAttack (actor, angle, MISSILERANGE, slope, damage);
     }
+
+    P_EndTraverseBatch ();
 }
 
 void A_CPosAttack (mobj_t* actor)
@@ -1158,6 +1163,7 @@ void A_VileChase (mobj_t* actor)
     
     int			bx;
     int			by;
+    fixed_t		bbox[4];
 
     mobjinfo_t*		info;
     mobj_t*		temp;
@@ -1174,6 +1180,11 @@ void A_VileChase (mobj_t* actor)
 	xh = (viletryx - bmaporgx + MAXRADIUS*2)>>MAPBLOCKSHIFT;
 	yl = (viletryy - bmaporgy - MAXRADIUS*2)>>MAPBLOCKSHIFT;
 	yh = (viletryy - bmaporgy + MAXRADIUS*2)>>MAPBLOCKSHIFT;
+
+	bbox[BOXTOP] = viletryy + mobjinfo[MT_VILE].radius;
+	bbox[BOXBOTTOM] = viletryy - mobjinfo[MT_VILE].radius;
+	bbox[BOXRIGHT] = viletryx + mobjinfo[MT_VILE].radius;
+	bbox[BOXLEFT] = viletryx - mobjinfo[MT_VILE].radius;
 	
 	vileobj = actor;
 	for (bx=xl ; bx<=xh ; bx++)
@@ -1183,7 +1194,7 @@ void A_VileChase (mobj_t* actor)
 		// Call PIT_VileCheck to check
 		// whether object is a corpse
 		// that canbe raised.
-		if (!P_BlockThingsIterator(bx,by,PIT_VileCheck))
+		if (!P_BlockThingsIteratorBox(bx,by,bbox,PIT_VileCheck))
 		{
 		    // got one!
 		    temp = actor->target;
@@ -1808,6 +1819,9 @@ mobj_t*		braintargets[32];
 int		numbraintargets;
 int		braintargeton = 0;
 
+// every other spit is skipped on the easy skills
+int		brainspiteasy = 0;
+
 void A_BrainAwake (mobj_t* mo)
 {
     thinker_t*	thinker;
@@ -1901,10 +1915,8 @@ void A_BrainSpit (mobj_t*	mo)
     mobj_t*	targ;
     mobj_t*	newmobj;
     
-    static int	easy = 0;
-	
-    easy ^= 1;
-    if (gameskill <= sk_easy && (!easy))
+    brainspiteasy ^= 1;
+    if (gameskill <= sk_easy && (!brainspiteasy))
 	return;
 		
     // shoot a cube at current target
@@ -22,6 +22,7 @@
 
 #ifndef __R_LOCAL__
 #include "r_local.h"
+#include "z_zone.h"
 #endif
 
 #define FLOATSPEED		(FRACUNIT*4)
@@ -67,6 +68,14 @@
 extern	thinker_t	thinkercap;	
 
 
+// slab pools for mobjs and sector special thinkers
+extern	zpool_t		mobjpool;
+extern	zpool_t		specialpool;
+
+// -thinkerbuckets: run thinkers grouped by kind, not in vanilla order
+extern	boolean		thinkerbuckets;
+
+void P_InitThinkerPools (void);
 void P_InitThinkers (void);
 void P_AddThinker (thinker_t* thinker);
 void P_RemoveThinker (thinker_t* thinker);
@@ -126,6 +135,12 @@ void	P_SpawnPlayerMissile (mobj_t* source, mobjtype_t type);
 //
 void P_NoiseAlert (mobj_t* target, mobj_t* emmiter);
 
+// The boss brain's spawn spots and turn, kept in snapshots.
+extern mobj_t*		braintargets[32];
+extern int		numbraintargets;
+extern int		braintargeton;
+extern int		brainspiteasy;
+
 
 //
 // P_MAPUTL
@@ -149,14 +164,16 @@ typedef struct
     }			d;
 } intercept_t;
 
-// Extended MAXINTERCEPTS, to allow for intercepts overrun emulation.
+// The intercepts array grows as needed.  Past the vanilla limit,
+// overruns are emulated if vanilla_intercepts_overrun is set.
 
 #define MAXINTERCEPTS_ORIGINAL 128
-#define MAXINTERCEPTS          (MAXINTERCEPTS_ORIGINAL + 61)
 
-extern intercept_t	intercepts[MAXINTERCEPTS];
+extern intercept_t*	intercepts;
 extern intercept_t*	intercept_p;
 
+extern int		vanilla_intercepts_overrun;
+
 typedef boolean (*traverser_t) (intercept_t *in);
 
 fixed_t P_AproxDistance (fixed_t dx, fixed_t dy);
@@ -176,6 +193,20 @@ void 	P_LineOpening (line_t* linedef);
 boolean P_BlockLinesIterator (int x, int y, boolean(*func)(line_t*) );
 boolean P_BlockThingsIterator (int x, int y, boolean(*func)(mobj_t*) );
 
+// -thinggrid: things are also kept in a grid finer than the blockmap
+extern boolean		thinggrid;
+
+void P_InitThingGrid (void);
+void P_ClearThingGrid (void);
+void P_RelinkThingGrid (void);
+
+boolean
+P_BlockThingsIteratorBox
+( int		x,
+  int		y,
+  fixed_t*	bbox,
+  boolean(*func)(mobj_t*) );
+
 #define PT_ADDLINES		1
 #define PT_ADDTHINGS	2
 #define PT_EARLYOUT		4
@@ -191,6 +222,11 @@ P_PathTraverse
   int		flags,
   boolean	(*trav) (intercept_t *));
 
+// Traces from x,y between these share the line tests
+// that do not depend on the direction of the trace.
+void P_BeginTraverseBatch (fixed_t x, fixed_t y);
+void P_EndTraverseBatch (void);
+
 void P_UnsetThingPosition (mobj_t* thing);
 void P_SetThingPosition (mobj_t* thing);
 
@@ -227,6 +263,13 @@ boolean P_TryMove (mobj_t* thing, fixed_t x, fixed_t y);
 boolean P_TeleportMove (mobj_t* thing, fixed_t x, fixed_t y);
 void	P_SlideMove (mobj_t* mo);
 boolean P_CheckSight (mobj_t* t1, mobj_t* t2);
+
+// Forgets remembered sight checks; after a sector moves.
+void P_ClearSightCache (void);
+
+extern unsigned int	sightcachehits;
+extern unsigned int	sightcachemisses;
+
 void 	P_UseLines (player_t* player);
 
 boolean P_ChangeSector (sector_t* sector, boolean crunch);
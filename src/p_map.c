@@ -175,7 +175,7 @@ P_TeleportMove
 
     for (bx=xl ; bx<=xh ; bx++)
 	for (by=yl ; by<=yh ; by++)
-	    if (!P_BlockThingsIterator(bx,by,PIT_StompThing))
+	    if (!P_BlockThingsIteratorBox(bx,by,tmbbox,PIT_StompThing))
 		return false;
     
     // the move is ok,
@@ -451,7 +451,7 @@ P_CheckPosition
 
     for (bx=xl ; bx<=xh ; bx++)
 	for (by=yl ; by<=yh ; by++)
-	    if (!P_BlockThingsIterator(bx,by,PIT_CheckThing))
+	    if (!P_BlockThingsIteratorBox(bx,by,tmbbox,PIT_CheckThing))
 		return false;
     
     // check lines
@@ -1264,6 +1264,7 @@ P_RadiusAttack
     int		yh;
     
     fixed_t	dist;
+    fixed_t	bbox[4];
 	
     dist = (damage+MAXRADIUS)<<FRACBITS;
     yh = (spot->y + dist - bmaporgy)>>MAPBLOCKSHIFT;
@@ -1273,10 +1274,15 @@ P_RadiusAttack
     bombspot = spot;
     bombsource = source;
     bombdamage = damage;
+
+    bbox[BOXTOP] = spot->y + (damage<<FRACBITS);
+    bbox[BOXBOTTOM] = spot->y - (damage<<FRACBITS);
+    bbox[BOXRIGHT] = spot->x + (damage<<FRACBITS);
+    bbox[BOXLEFT] = spot->x - (damage<<FRACBITS);
 	
     for (y=yl ; y<=yh ; y++)
 	for (x=xl ; x<=xh ; x++)
-	    P_BlockThingsIterator (x, y, PIT_RadiusAttack );
+	    P_BlockThingsIteratorBox (x, y, bbox, PIT_RadiusAttack );
 }
 
 
@@ -1374,6 +1380,9 @@ P_ChangeSector
 	
     nofit = false;
     crushchange = crunch;
+
+    // lines of sight through the sector may have opened or closed
+    P_ClearSightCache ();
 	
     // re-check heights for all things near the moving sector
     for (x=sector->blockbox[BOXLEFT] ; x<= sector->blockbox[BOXRIGHT] ; x++)
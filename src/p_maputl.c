@@ -23,9 +23,13 @@
 
 
 #include <stdlib.h>
+#include <string.h>
 
 
+#include "i_system.h"
+#include "m_argv.h"
 #include "m_bbox.h"
+#include "z_zone.h"
 
 #include "doomdef.h"
 #include "doomstat.h"
@@ -327,6 +331,177 @@ void P_LineOpening (line_t* linedef)
 }
 
 
+//
+// THING GRID
+// With -thinggrid, things in the blockmap are also linked into
+// cells of THINGCELLSIZE, THINGCELLS by THINGCELLS of them per
+// mapblock, so queries of a small area can pass over the things
+// of a crowded mapblock that are out of reach.
+//
+// The result must match walking the mapblock: the same things,
+// in the same order.  The blocklinks chain holds the newest link
+// first, so every link gets a stamp and the cells of a mapblock
+// are merged by it.  A cell is passed over only if none of its
+// things can reach the query box, going by the largest radius
+// linked into the cell since it was last empty.
+//
+#define THINGCELLSHIFT	(MAPBLOCKSHIFT-1)
+#define THINGCELLSIZE	(1<<THINGCELLSHIFT)
+#define THINGCELLS	(1<<(MAPBLOCKSHIFT-THINGCELLSHIFT))
+
+typedef struct
+{
+    mobj_t*	things;
+    fixed_t	maxradius;
+    int		count;
+} thingcell_t;
+
+boolean			thinggrid;
+
+static thingcell_t*	thingcells;
+static int		thingcellwidth;
+static unsigned int	thinglinkstamp;
+static unsigned int	thingcellchanges;
+
+// The largest maxradius of any cell this level.
+static fixed_t		thingcellreach;
+
+
+//
+// P_InitThingGrid
+// Only at game startup.
+//
+void P_InitThingGrid (void)
+{
+    //!
+    // @category game
+    //
+    // Keep things in a grid finer than the blockmap as well,
+    // which speeds up movement checks in crowds.  Demo
+    // compatible.
+    //
+
+    thinggrid = M_CheckParm ("-thinggrid") > 0;
+}
+
+
+//
+// P_ClearThingGrid
+// Right after the blockmap of a level is loaded.
+//
+void P_ClearThingGrid (void)
+{
+    int		count;
+
+    if (!thinggrid)
+	return;
+
+    thingcellwidth = bmapwidth * THINGCELLS;
+    count = thingcellwidth * bmapheight * THINGCELLS;
+    thingcells = Z_Malloc (count * sizeof(*thingcells), PU_LEVEL, 0);
+    memset (thingcells, 0, count * sizeof(*thingcells));
+    thinglinkstamp = 0;
+    thingcellreach = 0;
+}
+
+
+//
+// P_LinkThingCell
+// For things that just went into blocklinks.
+//
+static void P_LinkThingCell (mobj_t* thing)
+{
+    thingcell_t*	cell;
+    fixed_t		radius;
+
+    thing->cell = ((thing->y - bmaporgy) >> THINGCELLSHIFT) * thingcellwidth
+		+ ((thing->x - bmaporgx) >> THINGCELLSHIFT);
+    thing->linkstamp = ++thinglinkstamp;
+    thingcellchanges++;
+
+    cell = &thingcells[thing->cell];
+    thing->cprev = NULL;
+    thing->cnext = cell->things;
+    if (cell->things)
+	cell->things->cprev = thing;
+    cell->things = thing;
+
+    // PIT_VileCheck goes by the radius of the type
+    radius = thing->radius;
+    if (mobjinfo[thing->type].radius > radius)
+	radius = mobjinfo[thing->type].radius;
+
+    if (radius > cell->maxradius)
+	cell->maxradius = radius;
+
+    if (radius > thingcellreach)
+	thingcellreach = radius;
+
+    cell->count++;
+}
+
+
+//
+// P_UnlinkThingCell
+//
+static void P_UnlinkThingCell (mobj_t* thing)
+{
+    thingcell_t*	cell;
+
+    if (thing->cell < 0)
+	return;
+
+    cell = &thingcells[thing->cell];
+    thingcellchanges++;
+
+    if (thing->cnext)
+	thing->cnext->cprev = thing->cprev;
+
+    if (thing->cprev)
+	thing->cprev->cnext = thing->cnext;
+    else
+	cell->things = thing->cnext;
+
+    if (--cell->count == 0)
+	cell->maxradius = 0;
+}
+
+
+//
+// P_RelinkThingGrid
+// After a snapshot put the blocklinks chains back as they were,
+// see P_UnArchiveSnapshot.  Each chain is linked from its tail,
+// so the stamps go down along the chain.
+//
+void P_RelinkThingGrid (void)
+{
+    int		i;
+    mobj_t*	thing;
+
+    if (!thinggrid)
+	return;
+
+    memset (thingcells, 0, thingcellwidth * bmapheight * THINGCELLS
+	    * sizeof(*thingcells));
+    thingcellreach = 0;
+
+    for (i=0 ; i<bmapwidth*bmapheight ; i++)
+    {
+	thing = blocklinks[i];
+
+	if (!thing)
+	    continue;
+
+	while (thing->bnext)
+	    thing = thing->bnext;
+
+	for ( ; thing ; thing = thing->bprev)
+	    P_LinkThingCell (thing);
+    }
+}
+
+
+
 //
 // THING POSITION SETTING
 //
@@ -377,6 +552,9 @@ void P_UnsetThingPosition (mobj_t* thing)
 		blocklinks[blocky*bmapwidth+blockx] = thing->bnext;
 	    }
 	}
+
+	if (thinggrid)
+	    P_UnlinkThingCell (thing);
     }
 }
 
@@ -435,11 +613,15 @@ P_SetThingPosition (mobj_t* thing)
 		(*link)->bprev = thing;
 
 	    *link = thing;
+
+	    if (thinggrid)
+		P_LinkThingCell (thing);
 	}
 	else
 	{
 	    // thing is off the map
 	    thing->bnext = thing->bprev = NULL;
+	    thing->cell = -1;
 	}
     }
 }
@@ -532,19 +714,187 @@ P_BlockThingsIterator
 }
 
 
+//
+// P_BlockThingsIteratorBox
+// Like P_BlockThingsIterator, but with -thinggrid it leaves out
+//  things too far from bbox to matter.  func must ignore any
+//  thing that is further than its radius from bbox on an axis.
+//
+boolean
+P_BlockThingsIteratorBox
+( int			x,
+  int			y,
+  fixed_t*		bbox,
+  boolean(*func)(mobj_t*) )
+{
+    thingcell_t*	cells[THINGCELLS*THINGCELLS];
+    mobj_t*		last[THINGCELLS*THINGCELLS];
+    mobj_t*		next[THINGCELLS*THINGCELLS];
+    unsigned int	stamps[THINGCELLS*THINGCELLS];
+    thingcell_t*	cell;
+    mobj_t*		mobj;
+    unsigned int	newest;
+    unsigned int	changes;
+    fixed_t		left;
+    fixed_t		bottom;
+    int			numcells;
+    int			best;
+    int			xl;
+    int			xh;
+    int			yl;
+    int			yh;
+    int			cx;
+    int			cy;
+    int			i;
+
+    if (!thinggrid)
+	return P_BlockThingsIterator (x, y, func);
+
+    if ( x<0
+	 || y<0
+	 || x>=bmapwidth
+	 || y>=bmapheight
+	 || !blocklinks[y*bmapwidth+x])
+    {
+	return true;
+    }
+
+    // The cells of the block any thing could reach bbox from.
+    xl = (bbox[BOXLEFT] - thingcellreach - bmaporgx - 1) >> THINGCELLSHIFT;
+    xh = (bbox[BOXRIGHT] + thingcellreach - bmaporgx) >> THINGCELLSHIFT;
+    yl = (bbox[BOXBOTTOM] - thingcellreach - bmaporgy - 1) >> THINGCELLSHIFT;
+    yh = (bbox[BOXTOP] + thingcellreach - bmaporgy) >> THINGCELLSHIFT;
+
+    if (xl < x*THINGCELLS)
+	xl = x*THINGCELLS;
+    if (xh >= (x+1)*THINGCELLS)
+	xh = (x+1)*THINGCELLS - 1;
+    if (yl < y*THINGCELLS)
+	yl = y*THINGCELLS;
+    if (yh >= (y+1)*THINGCELLS)
+	yh = (y+1)*THINGCELLS - 1;
+
+    numcells = 0;
+
+    for (cy = yl ; cy <= yh ; cy++)
+    {
+	cell = &thingcells[cy*thingcellwidth + xl];
+	bottom = bmaporgy + (cy << THINGCELLSHIFT);
+
+	for (cx = xl ; cx <= xh ; cx++, cell++)
+	{
+	    if (!cell->things)
+		continue;
+
+	    left = bmaporgx + (cx << THINGCELLSHIFT);
+
+	    if (left + THINGCELLSIZE + cell->maxradius < bbox[BOXLEFT]
+		|| left - cell->maxradius > bbox[BOXRIGHT]
+		|| bottom + THINGCELLSIZE + cell->maxradius < bbox[BOXBOTTOM]
+		|| bottom - cell->maxradius > bbox[BOXTOP])
+	    {
+		continue;
+	    }
+
+	    cells[numcells] = cell;
+	    last[numcells] = NULL;
+	    next[numcells] = cell->things;
+	    stamps[numcells] = cell->things->linkstamp;
+	    numcells++;
+	}
+    }
+
+    if (!numcells)
+	return true;
+
+    newest = thinglinkstamp;
+    changes = thingcellchanges;
+
+    // Merge the cells back into blocklinks order.  Stamps
+    //  start at 1, so a cell that ran out has stamp 0.
+    for (;;)
+    {
+	best = 0;
+
+	for (i=1 ; i<numcells ; i++)
+	{
+	    if (stamps[i] > stamps[best])
+		best = i;
+	}
+
+	if (!stamps[best])
+	    return true;
+
+	mobj = next[best];
+	last[best] = mobj;
+
+	if (!func (mobj))
+	    return false;
+
+	if (thingcellchanges == changes)
+	{
+	    next[best] = mobj->cnext;
+	    stamps[best] = next[best] ? next[best]->linkstamp : 0;
+	    continue;
+	}
+
+	// func linked or unlinked things.  Go on from where the
+	//  walk of the chain would: past the things just visited,
+	//  and not into ones linked after the walk started.
+	changes = thingcellchanges;
+
+	for (i=0 ; i<numcells ; i++)
+	{
+	    mobj = last[i] ? last[i]->cnext : cells[i]->things;
+
+	    while (mobj && mobj->linkstamp > newest)
+		mobj = mobj->cnext;
+
+	    next[i] = mobj;
+	    stamps[i] = mobj ? mobj->linkstamp : 0;
+	}
+    }
+}
+
+
 
 //
 // INTERCEPT ROUTINES
 //
-intercept_t	intercepts[MAXINTERCEPTS];
+intercept_t*	intercepts;
 intercept_t*	intercept_p;
 
+static int	maxintercepts;
+
+// If non-zero, intercepts past the vanilla limit overwrite
+// the variables they did in Vanilla Doom.
+int		vanilla_intercepts_overrun = 1;
+
 divline_t 	trace;
 boolean 	earlyout;
 int		ptflags;
 
 static void InterceptsOverrun(int num_intercepts, intercept_t *intercept);
 
+
+//
+// CheckIntercept
+// Makes room for one more intercept at intercept_p.
+//
+static void CheckIntercept (void)
+{
+    int		count;
+
+    count = intercept_p - intercepts;
+
+    if (count < maxintercepts)
+	return;
+
+    maxintercepts = maxintercepts ? maxintercepts * 2 : MAXINTERCEPTS_ORIGINAL;
+    intercepts = I_Realloc (intercepts, maxintercepts * sizeof(*intercepts));
+    intercept_p = intercepts + count;
+}
+
 //
 // PIT_AddLineIntercepts.
 // Looks for lines in the given block
@@ -597,6 +947,7 @@ PIT_AddLineIntercepts (line_t* ld)
     }
     
 	
+    CheckIntercept ();
     intercept_p->frac = frac;
     intercept_p->isaline = true;
     intercept_p->d.line = ld;
@@ -663,6 +1014,7 @@ boolean PIT_AddThingIntercepts (mobj_t* thing)
     if (frac < 0)
 	return true;		// behind source
 
+    CheckIntercept ();
     intercept_p->frac = frac;
     intercept_p->isaline = false;
     intercept_p->d.thing = thing;
@@ -828,7 +1180,7 @@ static void InterceptsOverrun(int num_intercepts, intercept_t *intercept)
 {
     int location;
 
-    if (num_intercepts <= MAXINTERCEPTS_ORIGINAL)
+    if (num_intercepts <= MAXINTERCEPTS_ORIGINAL || !vanilla_intercepts_overrun)
     {
         // No overrun
 
@@ -850,6 +1202,267 @@ static void InterceptsOverrun(int num_intercepts, intercept_t *intercept)
 }
 
 
+//
+// TRAVERSE BATCHES
+// Between P_BeginTraverseBatch and P_EndTraverseBatch, the lines
+// of each mapblock a trace from the batch origin passes through
+// are cached the first time, with their ends relative to the
+// origin and the numerator of P_InterceptVector, which do not
+// depend on where the trace is going.  Each trace still walks
+// its own mapblocks and gets the same intercepts in the same
+// order as through PIT_AddLineIntercepts.
+//
+typedef struct
+{
+    line_t*	line;
+    fixed_t	dx1;
+    fixed_t	dy1;
+    fixed_t	dx2;
+    fixed_t	dy2;
+    fixed_t	ldx;
+    fixed_t	ldy;
+    fixed_t	num;
+    boolean	solid;
+    int		validcount;
+} traceline_t;
+
+typedef struct
+{
+    unsigned int	batch;
+    int			start;
+    int			count;
+} traceblock_t;
+
+typedef struct
+{
+    unsigned int	batch;
+    int			index;
+} traceslot_t;
+
+static boolean		tracebatch;
+static unsigned int	tracebatchnum;
+static fixed_t		batchx;
+static fixed_t		batchy;
+
+static traceline_t*	tracelines;
+static int		numtracelines;
+static int		maxtracelines;
+
+// Indexes into tracelines, a run for each cached mapblock.
+static int*		tracelists;
+static int		numtracelists;
+static int		maxtracelists;
+
+static traceblock_t*	traceblocks;
+static int		maxtraceblocks;
+
+static traceslot_t*	traceslots;
+static int		maxtraceslots;
+
+
+//
+// P_BeginTraverseBatch
+//
+void P_BeginTraverseBatch (fixed_t x, fixed_t y)
+{
+    int		count;
+
+    count = bmapwidth * bmapheight;
+
+    if (count > maxtraceblocks)
+    {
+	traceblocks = I_Realloc (traceblocks, count * sizeof(*traceblocks));
+	memset (traceblocks, 0, count * sizeof(*traceblocks));
+	maxtraceblocks = count;
+    }
+
+    if (numlines > maxtraceslots)
+    {
+	traceslots = I_Realloc (traceslots, numlines * sizeof(*traceslots));
+	memset (traceslots, 0, numlines * sizeof(*traceslots));
+	maxtraceslots = numlines;
+    }
+
+    tracebatch = true;
+    tracebatchnum++;
+    batchx = x;
+    batchy = y;
+    numtracelines = 0;
+    numtracelists = 0;
+}
+
+
+void P_EndTraverseBatch (void)
+{
+    tracebatch = false;
+}
+
+
+//
+// P_CacheTraceLine
+// Returns the index of ld in tracelines.
+//
+static int P_CacheTraceLine (line_t* ld)
+{
+    traceslot_t*	slot;
+    traceline_t*	tl;
+
+    slot = &traceslots[ld - lines];
+
+    if (slot->batch == tracebatchnum)
+	return slot->index;
+
+    if (numtracelines == maxtracelines)
+    {
+	maxtracelines = maxtracelines ? maxtracelines * 2 : 256;
+	tracelines = I_Realloc (tracelines,
+				maxtracelines * sizeof(*tracelines));
+    }
+
+    slot->batch = tracebatchnum;
+    slot->index = numtracelines;
+
+    // As P_PointOnDivlineSide and P_InterceptVector have them.
+    tl = &tracelines[numtracelines++];
+    tl->line = ld;
+    tl->dx1 = ld->v1->x - trace.x;
+    tl->dy1 = ld->v1->y - trace.y;
+    tl->dx2 = ld->v2->x - trace.x;
+    tl->dy2 = ld->v2->y - trace.y;
+    tl->ldx = ld->dx>>8;
+    tl->ldy = ld->dy>>8;
+    tl->num = FixedMul ((ld->v1->x - trace.x)>>8, ld->dy)
+	    + FixedMul ((trace.y - ld->v1->y)>>8, ld->dx);
+    tl->solid = !ld->backsector;
+    tl->validcount = 0;
+
+    return slot->index;
+}
+
+
+//
+// P_CacheTraceBlock
+//
+static traceblock_t* P_CacheTraceBlock (int x, int y)
+{
+    traceblock_t*	block;
+    short*		list;
+
+    block = &traceblocks[y*bmapwidth+x];
+
+    if (block->batch == tracebatchnum)
+	return block;
+
+    block->batch = tracebatchnum;
+    block->start = numtracelists;
+
+    for (list = blockmaplump+blockmap[y*bmapwidth+x] ; *list != -1 ; list++)
+    {
+	if (numtracelists == maxtracelists)
+	{
+	    maxtracelists = maxtracelists ? maxtracelists * 2 : 1024;
+	    tracelists = I_Realloc (tracelists,
+				    maxtracelists * sizeof(*tracelists));
+	}
+
+	tracelists[numtracelists++] = P_CacheTraceLine (&lines[*list]);
+    }
+
+    block->count = numtracelists - block->start;
+
+    return block;
+}
+
+
+//
+// P_TraceLineSide
+// P_PointOnDivlineSide against trace, for a trace that
+// is neither horizontal nor vertical.
+//
+static int P_TraceLineSide (fixed_t dx, fixed_t dy)
+{
+    fixed_t	left;
+    fixed_t	right;
+
+    if ( (trace.dy ^ trace.dx ^ dx ^ dy)&0x80000000 )
+    {
+	if ( (trace.dy ^ dx) & 0x80000000 )
+	    return 1;
+	return 0;
+    }
+
+    left = FixedMul ( trace.dy>>8, dx>>8 );
+    right = FixedMul ( dy>>8 , trace.dx>>8 );
+
+    if (right < left)
+	return 0;
+    return 1;
+}
+
+
+//
+// P_AddBatchLineIntercepts
+// P_BlockLinesIterator with PIT_AddLineIntercepts, from
+// the cached lines of the mapblock.
+//
+static boolean P_AddBatchLineIntercepts (int x, int y)
+{
+    traceblock_t*	block;
+    traceline_t*	tl;
+    fixed_t		den;
+    fixed_t		frac;
+    int			i;
+
+    if (x<0
+	|| y<0
+	|| x>=bmapwidth
+	|| y>=bmapheight)
+    {
+	return true;
+    }
+
+    block = P_CacheTraceBlock (x, y);
+
+    for (i=block->start ; i<block->start+block->count ; i++)
+    {
+	tl = &tracelines[tracelists[i]];
+
+	if (tl->validcount == validcount)
+	    continue;
+
+	tl->validcount = validcount;
+
+	if (P_TraceLineSide (tl->dx1, tl->dy1)
+	    == P_TraceLineSide (tl->dx2, tl->dy2))
+	{
+	    continue;	// line isn't crossed
+	}
+
+	den = FixedMul (tl->ldy, trace.dx) - FixedMul (tl->ldx, trace.dy);
+	frac = den ? FixedDiv (tl->num, den) : 0;
+
+	if (frac < 0)
+	    continue;	// behind source
+
+	if (earlyout
+	    && frac < FRACUNIT
+	    && tl->solid)
+	{
+	    return false;
+	}
+
+	CheckIntercept ();
+	intercept_p->frac = frac;
+	intercept_p->isaline = true;
+	intercept_p->d.line = tl->line;
+	InterceptsOverrun(intercept_p - intercepts, intercept_p);
+	intercept_p++;
+    }
+
+    return true;
+}
+
+
 //
 // P_PathTraverse
 // Traces a line from x1,y1 to x2,y2,
@@ -886,11 +1499,14 @@ P_PathTraverse
     int		mapystep;
 
     int		count;
+    boolean	batched;
 		
     earlyout = flags & PT_EARLYOUT;
 		
     validcount++;
     intercept_p = intercepts;
+
+    batched = tracebatch && x1 == batchx && y1 == batchy;
 	
     if ( ((x1-bmaporgx)&(MAPBLOCKSIZE-1)) == 0)
 	x1 += FRACUNIT;	// don't side exactly on a line
@@ -903,6 +1519,18 @@ P_PathTraverse
     trace.dx = x2 - x1;
     trace.dy = y2 - y1;
 
+    // Only long, slanted traces go the way PIT_AddLineIntercepts
+    //  does with P_PointOnDivlineSide.
+    if ( !trace.dx
+	 || !trace.dy
+	 || (trace.dx <= FRACUNIT*16
+	     && trace.dy <= FRACUNIT*16
+	     && trace.dx >= -FRACUNIT*16
+	     && trace.dy >= -FRACUNIT*16) )
+    {
+	batched = false;
+    }
+
     x1 -= bmaporgx;
     y1 -= bmaporgy;
     xt1 = x1>>MAPBLOCKSHIFT;
@@ -965,7 +1593,12 @@ P_PathTraverse
     {
 	if (flags & PT_ADDLINES)
 	{
-	    if (!P_BlockLinesIterator (mapx, mapy,PIT_AddLineIntercepts))
+	    if (batched)
+	    {
+		if (!P_AddBatchLineIntercepts (mapx, mapy))
+		    return false;	// early out
+	    }
+	    else if (!P_BlockLinesIterator (mapx, mapy,PIT_AddLineIntercepts))
 		return false;	// early out
 	}
 	
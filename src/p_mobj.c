@@ -513,7 +513,7 @@ P_SpawnMobj
     state_t*	st;
     mobjinfo_t*	info;
 	
-    mobj = Z_Malloc (sizeof(*mobj), PU_LEVEL, NULL);
+    mobj = Z_PoolAlloc (&mobjpool);
     memset (mobj, 0, sizeof (*mobj));
     info = &mobjinfo[type];
 	
@@ -221,6 +221,13 @@ typedef struct mobj_s
     // Links in blocks (if needed).
     struct mobj_s*	bnext;
     struct mobj_s*	bprev;
+
+    // Links in the finer -thinggrid cells, the cell
+    // (-1 if none) and when the thing was linked.
+    struct mobj_s*	cnext;
+    struct mobj_s*	cprev;
+    int			cell;
+    unsigned int	linkstamp;
     
     struct subsector_s*	subsector;
 
@@ -276,6 +283,15 @@ typedef struct mobj_s
 
     // Thing being chased/attacked for tracers.
     struct mobj_s*	tracer;	
+
+    // Where the thing was at the end of the last tic, for
+    //  drawing between tics with -uncapped.  Only valid
+    //  while interp is set, see P_StoreInterpolations.
+    fixed_t		oldx;
+    fixed_t		oldy;
+    fixed_t		oldz;
+    angle_t		oldangle;
+    boolean		interp;
     
 } mobj_t;
 
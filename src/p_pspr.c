@@ -690,10 +690,13 @@ A_FireShotgun
 		  ps_flash,
 		  weaponinfo[player->readyweapon].flashstate);
 
+    P_BeginTraverseBatch (player->mo->x, player->mo->y);
     P_BulletSlope (player->mo);
 	
     for (i=0 ; i<7 ; i++)
 	P_GunShot (player->mo, false);
+
+    P_EndTraverseBatch ();
 }
 
 
@@ -720,6 +723,7 @@ A_FireShotgun2
 		  ps_flash,
 		  weaponinfo[player->readyweapon].flashstate);
 
+    P_BeginTraverseBatch (player->mo->x, player->mo->y);
     P_BulletSlope (player->mo);
 	
     for (i=0 ; i<20 ; i++)
@@ -732,6 +736,8 @@ A_FireShotgun2
 		      MISSILERANGE,
 		      bulletslope + ((P_Random()-P_Random())<<5), damage);
     }
+
+    P_EndTraverseBatch ();
 }
 
 
@@ -17,8 +17,10 @@
 //
 
 
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "dstrings.h"
 #include "deh_main.h"
@@ -39,10 +41,14 @@
 #define SAVEGAME_EOF 0x1d
 #define VERSIONSIZE 16
 
+// Savegames are serialized in memory: a whole file is read in
+// before parsing, and a save goes out with a single write.
 struct {
 	kinc_file_writer_t writer;
-	kinc_file_reader_t reader;
-	unsigned long bytes_written;
+	byte *buffer;
+	size_t size;		// bytes allocated
+	size_t length;		// bytes of savegame data
+	size_t pos;		// read position
 } save_game;
 
 int savegamelength;
@@ -67,28 +73,47 @@ char *P_SaveGameFile(int slot)
 	return filename;
 }
 
+// Makes room for size bytes in the savegame buffer.
+
+static void saveg_reserve(size_t size)
+{
+	size_t newsize;
+
+	if (size <= save_game.size)
+		return;
+
+	newsize = save_game.size ? save_game.size : SAVEGAMESIZE;
+
+	while (newsize < size)
+		newsize *= 2;
+
+	save_game.buffer = I_Realloc(save_game.buffer, newsize);
+	save_game.size = newsize;
+}
+
 // Endian-safe integer read/write functions
 
 static byte saveg_read8(void)
 {
-	byte result;
-
-	if (kinc_file_reader_read(&save_game.reader, &result, 1) < 1) {
+	if (save_game.pos >= save_game.length) {
 		if (!savegame_error) {
 			fprintf(stderr, "saveg_read8: Unexpected end of file while "
 			                "reading save game\n");
 
 			savegame_error = true;
 		}
+		return 0;
 	}
 
-	return result;
+	return save_game.buffer[save_game.pos++];
 }
 
 static void saveg_write8(byte value)
 {
-	kinc_file_writer_write(&save_game.writer, &value, 1);
-	save_game.bytes_written++;
+	if (save_game.length >= save_game.size)
+		saveg_reserve(save_game.length + 1);
+
+	save_game.buffer[save_game.length++] = value;
 }
 
 static short saveg_read16(void)
@@ -131,7 +156,7 @@ static void saveg_write32(int value)
 
 static void saveg_read_pad(void)
 {
-	unsigned long pos = kinc_file_reader_pos(&save_game.reader);
+	unsigned long pos = save_game.pos;
 	int padding;
 	int i;
 
@@ -144,7 +169,7 @@ static void saveg_read_pad(void)
 
 static void saveg_write_pad(void)
 {
-    unsigned long pos = save_game.bytes_written;
+    unsigned long pos = save_game.length;
     int padding;
     int i;
 
@@ -169,6 +194,134 @@ static void saveg_writep(void *p)
     saveg_write32((intptr_t) p);
 }
 
+//
+// Snapshots, see G_SaveSnapshot, are restored into the running
+// level and must carry on exactly as the game did.  They store a
+// mobj pointer as the 1-based position of the mobj among the
+// archived ones, and P_UnArchiveSnapshot relinks the pointers
+// once every mobj has been read back.  Removed mobjs are not
+// archived, pointers to them come back NULL.
+//
+
+static boolean saveg_snapshot;
+
+// The archived mobjs in order, and a hash from mobj to position
+// while writing.
+
+typedef struct
+{
+    mobj_t *mobj;
+    int index;
+} snapmobjslot_t;
+
+static mobj_t **snapmobjs;
+static int numsnapmobjs;
+static int maxsnapmobjs;
+
+static snapmobjslot_t *snapmobjhash;
+static int snapmobjhashbits;
+
+#define SnapMobjHash(mobj) \
+    (((unsigned int) ((uintptr_t) (mobj) >> 4) * 0x9e3779b1u) \
+     >> (32 - snapmobjhashbits))
+
+static void saveg_add_snapmobj(mobj_t *mobj)
+{
+    if (numsnapmobjs == maxsnapmobjs)
+    {
+        maxsnapmobjs = maxsnapmobjs ? maxsnapmobjs * 2 : 256;
+        snapmobjs = I_Realloc(snapmobjs, maxsnapmobjs * sizeof(*snapmobjs));
+    }
+
+    snapmobjs[numsnapmobjs++] = mobj;
+}
+
+// Numbers the mobjs in the order P_ArchiveThinkers writes them.
+
+static void saveg_number_mobjs(void)
+{
+    thinker_t *th;
+    unsigned int mask;
+    unsigned int slot;
+    int bits;
+    int i;
+
+    numsnapmobjs = 0;
+
+    for (th = thinkercap.next; th != &thinkercap; th = th->next)
+    {
+        if (th->function.acp1 == (actionf_p1) P_MobjThinker)
+            saveg_add_snapmobj((mobj_t *) th);
+    }
+
+    // at most half full
+    for (bits = 8; (1 << bits) < numsnapmobjs * 2; bits++);
+
+    if (bits != snapmobjhashbits)
+    {
+        snapmobjhashbits = bits;
+        snapmobjhash = I_Realloc(snapmobjhash,
+                                 (1 << bits) * sizeof(*snapmobjhash));
+    }
+
+    memset(snapmobjhash, 0, (1 << bits) * sizeof(*snapmobjhash));
+    mask = (1 << bits) - 1;
+
+    for (i = 0; i < numsnapmobjs; i++)
+    {
+        slot = SnapMobjHash(snapmobjs[i]);
+
+        while (snapmobjhash[slot].mobj != NULL)
+            slot = (slot + 1) & mask;
+
+        snapmobjhash[slot].mobj = snapmobjs[i];
+        snapmobjhash[slot].index = i + 1;
+    }
+}
+
+static int saveg_mobj_index(mobj_t *mobj)
+{
+    unsigned int mask;
+    unsigned int slot;
+
+    if (mobj == NULL)
+        return 0;
+
+    mask = (1 << snapmobjhashbits) - 1;
+
+    for (slot = SnapMobjHash(mobj); snapmobjhash[slot].mobj != NULL;
+         slot = (slot + 1) & mask)
+    {
+        if (snapmobjhash[slot].mobj == mobj)
+            return snapmobjhash[slot].index;
+    }
+
+    return 0;
+}
+
+// Mobj pointers: an index in snapshots, as vanilla wrote them
+// in savegames otherwise.
+
+static void saveg_writemobj(mobj_t *mobj)
+{
+    if (saveg_snapshot)
+        saveg_write32(saveg_mobj_index(mobj));
+    else
+        saveg_writep(mobj);
+}
+
+// Turns an index read into a pointer field back into the mobj.
+
+static mobj_t *saveg_relinkmobj(void *index)
+{
+    intptr_t i = (intptr_t) index;
+
+    if (i <= 0 || i > numsnapmobjs)
+        return NULL;
+
+    return snapmobjs[i - 1];
+}
+
 // Enum values are 32-bit integers.
 
 #define saveg_read_enum saveg_read32
@@ -410,10 +563,10 @@ static void saveg_write_mobj_t(mobj_t *str)
     saveg_write32(str->z);
 
     // struct mobj_s* snext;
-    saveg_writep(str->snext);
+    saveg_writemobj(str->snext);
 
     // struct mobj_s* sprev;
-    saveg_writep(str->sprev);
+    saveg_writemobj(str->sprev);
 
     // angle_t angle;
     saveg_write32(str->angle);
@@ -425,10 +578,10 @@ static void saveg_write_mobj_t(mobj_t *str)
     saveg_write32(str->frame);
 
     // struct mobj_s* bnext;
-    saveg_writep(str->bnext);
+    saveg_writemobj(str->bnext);
 
     // struct mobj_s* bprev;
-    saveg_writep(str->bprev);
+    saveg_writemobj(str->bprev);
 
     // struct subsector_s* subsector;
     saveg_writep(str->subsector);
@@ -482,7 +635,7 @@ static void saveg_write_mobj_t(mobj_t *str)
     saveg_write32(str->movecount);
 
     // struct mobj_s* target;
-    saveg_writep(str->target);
+    saveg_writemobj(str->target);
 
     // int reactiontime;
     saveg_write32(str->reactiontime);
@@ -507,7 +660,7 @@ static void saveg_write_mobj_t(mobj_t *str)
     saveg_write_mapthing_t(&str->spawnpoint);
 
     // struct mobj_s* tracer;
-    saveg_writep(str->tracer);
+    saveg_writemobj(str->tracer);
 }
 
 
@@ -856,7 +1009,7 @@ static void saveg_write_player_t(player_t *str)
     saveg_write32(str->bonuscount);
 
     // mobj_t* attacker;
-    saveg_writep(str->attacker);
+    saveg_writemobj(str->attacker);
 
     // int extralight;
     saveg_write32(str->extralight);
@@ -1164,6 +1317,49 @@ static void saveg_write_plat_t(plat_t *str)
     saveg_write_enum(str->type);
 }
 
+//
+// fireflicker_t
+//
+
+static void saveg_read_fireflicker_t(fireflicker_t *str)
+{
+    int sector;
+
+    // thinker_t thinker;
+    saveg_read_thinker_t(&str->thinker);
+
+    // sector_t* sector;
+    sector = saveg_read32();
+    str->sector = &sectors[sector];
+
+    // int count;
+    str->count = saveg_read32();
+
+    // int maxlight;
+    str->maxlight = saveg_read32();
+
+    // int minlight;
+    str->minlight = saveg_read32();
+}
+
+static void saveg_write_fireflicker_t(fireflicker_t *str)
+{
+    // thinker_t thinker;
+    saveg_write_thinker_t(&str->thinker);
+
+    // sector_t* sector;
+    saveg_write32(str->sector - sectors);
+
+    // int count;
+    saveg_write32(str->count);
+
+    // int maxlight;
+    saveg_write32(str->maxlight);
+
+    // int minlight;
+    saveg_write32(str->minlight);
+}
+
 //
 // lightflash_t
 //
@@ -1450,7 +1646,10 @@ void P_UnArchivePlayers (void)
 	// will be set when unarc thinker
 	players[i].mo = NULL;	
 	players[i].message = NULL;
-	players[i].attacker = NULL;
+
+	// relinked by P_UnArchiveSnapshot
+	if (!saveg_snapshot)
+	    players[i].attacker = NULL;
     }
 }
 
@@ -1526,6 +1725,8 @@ void P_UnArchiveWorld (void)
 	sec->tag = saveg_read16();		// needed?
 	sec->specialdata = 0;
 	sec->soundtarget = 0;
+	sec->oldfloorheight = sec->floorheight;
+	sec->oldceilingheight = sec->ceilingheight;
     }
     
     // do lines
@@ -1558,13 +1759,38 @@ void P_UnArchiveWorld (void)
 typedef enum
 {
     tc_end,
-    tc_mobj
+    tc_mobj,
+    tc_special		// snapshots only, a P_ArchiveSpecials record
 
 } thinkerclass_t;
 
 
+//
+// P_ArchiveSpecials
+//
+enum
+{
+    tc_ceiling,
+    tc_door,
+    tc_floor,
+    tc_plat,
+    tc_flash,
+    tc_strobe,
+    tc_glow,
+    tc_endspecials,
+    tc_fireflicker	// snapshots only, vanilla does not save them
+
+} specials_e;	
+
+
+static void P_ArchiveSpecial (thinker_t* th);
+static void P_UnArchiveSpecial (byte tclass);
+
+
 //
 // P_ArchiveThinkers
+// Snapshots keep the specials in here as well, so the thinkers
+//  come back in the order they run in.
 //
 void P_ArchiveThinkers (void)
 {
@@ -1581,6 +1807,9 @@ void P_ArchiveThinkers (void)
 
 	    continue;
 	}
+
+	if (saveg_snapshot)
+	    P_ArchiveSpecial (th);
 		
 	// I_Error ("P_ArchiveThinkers: Unknown thinker function");
     }
@@ -1600,6 +1829,7 @@ void P_UnArchiveThinkers (void)
     thinker_t*		currentthinker;
     thinker_t*		next;
     mobj_t*		mobj;
+    int			i;
     
     // remove all the current thinkers
     currentthinker = thinkercap.next;
@@ -1609,12 +1839,25 @@ void P_UnArchiveThinkers (void)
 	
 	if (currentthinker->function.acp1 == (actionf_p1)P_MobjThinker)
 	    P_RemoveMobj ((mobj_t *)currentthinker);
-	else
-	    Z_Free (currentthinker);
+
+	Z_PoolFree (currentthinker);
 
 	currentthinker = next;
     }
     P_InitThinkers ();
+
+    // The specials went with them.  Only matters when restoring
+    //  into a running level, see G_LoadSnapshot.
+    for (i = 0;i < MAXCEILINGS;i++)
+	activeceilings[i] = NULL;
+
+    for (i = 0;i < MAXPLATS;i++)
+	activeplats[i] = NULL;
+
+    for (i = 0;i < MAXBUTTONS;i++)
+	memset(&buttonlist[i],0,sizeof(button_t));
+
+    numsnapmobjs = 0;
     
     // read in saved thinkers
     while (1)
@@ -1627,19 +1870,37 @@ void P_UnArchiveThinkers (void)
 			
 	  case tc_mobj:
 	    saveg_read_pad();
-	    mobj = Z_Malloc (sizeof(*mobj), PU_LEVEL, NULL);
+	    mobj = Z_PoolAlloc (&mobjpool);
             saveg_read_mobj_t(mobj);
 
-	    mobj->target = NULL;
-            mobj->tracer = NULL;
-	    P_SetThingPosition (mobj);
+	    if (saveg_snapshot)
+	    {
+		// links and floorz as they were, see P_UnArchiveSnapshot
+		mobj->subsector = R_PointInSubsector (mobj->x, mobj->y);
+		mobj->cell = -1;
+		saveg_add_snapmobj (mobj);
+	    }
+	    else
+	    {
+		mobj->target = NULL;
+		mobj->tracer = NULL;
+		P_SetThingPosition (mobj);
+		mobj->floorz = mobj->subsector->sector->floorheight;
+		mobj->ceilingz = mobj->subsector->sector->ceilingheight;
+	    }
+	    mobj->interp = false;
 	    mobj->info = &mobjinfo[mobj->type];
-	    mobj->floorz = mobj->subsector->sector->floorheight;
-	    mobj->ceilingz = mobj->subsector->sector->ceilingheight;
 	    mobj->thinker.function.acp1 = (actionf_p1)P_MobjThinker;
 	    P_AddThinker (&mobj->thinker);
 	    break;
 
+	  case tc_special:
+	    if (!saveg_snapshot)
+		I_Error ("Unknown tclass %i in savegame",tclass);
+
+	    P_UnArchiveSpecial (saveg_read8());
+	    break;
+
 	  default:
 	    I_Error ("Unknown tclass %i in savegame",tclass);
 	}
@@ -1649,24 +1910,6 @@ void P_UnArchiveThinkers (void)
 }
 
 
-//
-// P_ArchiveSpecials
-//
-enum
-{
-    tc_ceiling,
-    tc_door,
-    tc_floor,
-    tc_plat,
-    tc_flash,
-    tc_strobe,
-    tc_glow,
-    tc_endspecials
-
-} specials_e;	
-
-
-
 //
 // Things to handle:
 //
@@ -1677,90 +1920,141 @@ enum
 // T_StrobeFlash, (strobe_t: sector_t *),
 // T_Glow, (glow_t: sector_t *),
 // T_PlatRaise, (plat_t: sector_t *), - active list
+// T_FireFlicker, (fireflicker_t: sector_t *), - snapshots only
 //
 void P_ArchiveSpecials (void)
 {
     thinker_t*		th;
-    int			i;
+
+    // snapshots have them in with the mobjs
+    if (!saveg_snapshot)
+    {
+	// save off the current thinkers
+	for (th = thinkercap.next ; th != &thinkercap ; th=th->next)
+	    P_ArchiveSpecial (th);
+    }
 	
-    // save off the current thinkers
-    for (th = thinkercap.next ; th != &thinkercap ; th=th->next)
+    // add a terminating marker
+    saveg_write8(tc_endspecials);
+
+}
+
+
+//
+// P_WriteSpecialClass
+// Snapshots have the specials in with the mobjs, see
+//  P_ArchiveThinkers.
+//
+static void P_WriteSpecialClass (byte tclass)
+{
+    if (saveg_snapshot)
+	saveg_write8(tc_special);
+
+    saveg_write8(tclass);
+}
+
+
+//
+// P_ArchiveSpecial
+//
+static void P_ArchiveSpecial (thinker_t* th)
+{
+    int			i;
+
+    if (th->function.acv == (actionf_v)NULL)
     {
-	if (th->function.acv == (actionf_v)NULL)
+	for (i = 0; i < MAXCEILINGS;i++)
+	    if (activeceilings[i] == (ceiling_t *)th)
+		break;
+	    
+	if (i<MAXCEILINGS)
 	{
-	    for (i = 0; i < MAXCEILINGS;i++)
-		if (activeceilings[i] == (ceiling_t *)th)
+            P_WriteSpecialClass(tc_ceiling);
+	    saveg_write_pad();
+            saveg_write_ceiling_t((ceiling_t *) th);
+	    return;
+	}
+
+	// vanilla loses plats in stasis
+	if (saveg_snapshot)
+	{
+	    for (i = 0; i < MAXPLATS;i++)
+		if (activeplats[i] == (plat_t *)th)
 		    break;
-	    
-	    if (i<MAXCEILINGS)
+
+	    if (i<MAXPLATS)
 	    {
-                saveg_write8(tc_ceiling);
+		P_WriteSpecialClass(tc_plat);
 		saveg_write_pad();
-                saveg_write_ceiling_t((ceiling_t *) th);
+		saveg_write_plat_t((plat_t *) th);
+		return;
 	    }
-	    continue;
 	}
+	return;
+    }
 			
-	if (th->function.acp1 == (actionf_p1)T_MoveCeiling)
-	{
-            saveg_write8(tc_ceiling);
-	    saveg_write_pad();
-            saveg_write_ceiling_t((ceiling_t *) th);
-	    continue;
-	}
+    if (th->function.acp1 == (actionf_p1)T_MoveCeiling)
+    {
+        P_WriteSpecialClass(tc_ceiling);
+	saveg_write_pad();
+        saveg_write_ceiling_t((ceiling_t *) th);
+	return;
+    }
 			
-	if (th->function.acp1 == (actionf_p1)T_VerticalDoor)
-	{
-            saveg_write8(tc_door);
-	    saveg_write_pad();
-            saveg_write_vldoor_t((vldoor_t *) th);
-	    continue;
-	}
+    if (th->function.acp1 == (actionf_p1)T_VerticalDoor)
+    {
+        P_WriteSpecialClass(tc_door);
+	saveg_write_pad();
+        saveg_write_vldoor_t((vldoor_t *) th);
+	return;
+    }
 			
-	if (th->function.acp1 == (actionf_p1)T_MoveFloor)
-	{
-            saveg_write8(tc_floor);
-	    saveg_write_pad();
-            saveg_write_floormove_t((floormove_t *) th);
-	    continue;
-	}
+    if (th->function.acp1 == (actionf_p1)T_MoveFloor)
+    {
+        P_WriteSpecialClass(tc_floor);
+	saveg_write_pad();
+        saveg_write_floormove_t((floormove_t *) th);
+	return;
+    }
 			
-	if (th->function.acp1 == (actionf_p1)T_PlatRaise)
-	{
-            saveg_write8(tc_plat);
-	    saveg_write_pad();
-            saveg_write_plat_t((plat_t *) th);
-	    continue;
-	}
+    if (th->function.acp1 == (actionf_p1)T_PlatRaise)
+    {
+        P_WriteSpecialClass(tc_plat);
+	saveg_write_pad();
+        saveg_write_plat_t((plat_t *) th);
+	return;
+    }
 			
-	if (th->function.acp1 == (actionf_p1)T_LightFlash)
-	{
-            saveg_write8(tc_flash);
-	    saveg_write_pad();
-            saveg_write_lightflash_t((lightflash_t *) th);
-	    continue;
-	}
+    if (th->function.acp1 == (actionf_p1)T_LightFlash)
+    {
+        P_WriteSpecialClass(tc_flash);
+	saveg_write_pad();
+        saveg_write_lightflash_t((lightflash_t *) th);
+	return;
+    }
 			
-	if (th->function.acp1 == (actionf_p1)T_StrobeFlash)
-	{
-            saveg_write8(tc_strobe);
-	    saveg_write_pad();
-            saveg_write_strobe_t((strobe_t *) th);
-	    continue;
-	}
+    if (th->function.acp1 == (actionf_p1)T_StrobeFlash)
+    {
+        P_WriteSpecialClass(tc_strobe);
+	saveg_write_pad();
+        saveg_write_strobe_t((strobe_t *) th);
+	return;
+    }
 			
-	if (th->function.acp1 == (actionf_p1)T_Glow)
-	{
-            saveg_write8(tc_glow);
-	    saveg_write_pad();
-            saveg_write_glow_t((glow_t *) th);
-	    continue;
-	}
+    if (th->function.acp1 == (actionf_p1)T_Glow)
+    {
+        P_WriteSpecialClass(tc_glow);
+	saveg_write_pad();
+        saveg_write_glow_t((glow_t *) th);
+	return;
     }
-	
-    // add a terminating marker
-    saveg_write8(tc_endspecials);
 
+    if (saveg_snapshot && th->function.acp1 == (actionf_p1)T_FireFlicker)
+    {
+        P_WriteSpecialClass(tc_fireflicker);
+	saveg_write_pad();
+        saveg_write_fireflicker_t((fireflicker_t *) th);
+    }
 }
 
 
@@ -1770,6 +2064,26 @@ void P_ArchiveSpecials (void)
 void P_UnArchiveSpecials (void)
 {
     byte		tclass;
+	
+    // read in saved thinkers
+    while (1)
+    {
+	tclass = saveg_read8();
+
+	if (tclass == tc_endspecials)
+	    return;	// end of list
+
+	P_UnArchiveSpecial (tclass);
+    }
+
+}
+
+
+//
+// P_UnArchiveSpecial
+//
+static void P_UnArchiveSpecial (byte tclass)
+{
     ceiling_t*		ceiling;
     vldoor_t*		door;
     floormove_t*	floor;
@@ -1777,113 +2091,360 @@ void P_UnArchiveSpecials (void)
     lightflash_t*	flash;
     strobe_t*		strobe;
     glow_t*		glow;
-	
-	
-    // read in saved thinkers
-    while (1)
-    {
-	tclass = saveg_read8();
+    fireflicker_t*	flicker;
 
-	switch (tclass)
-	{
-	  case tc_endspecials:
-	    return;	// end of list
-			
-	  case tc_ceiling:
-	    saveg_read_pad();
-	    ceiling = Z_Malloc (sizeof(*ceiling), PU_LEVEL, NULL);
-            saveg_read_ceiling_t(ceiling);
-	    ceiling->sector->specialdata = ceiling;
+    switch (tclass)
+    {
+      case tc_ceiling:
+	saveg_read_pad();
+	ceiling = Z_PoolAlloc (&specialpool);
+        saveg_read_ceiling_t(ceiling);
+	ceiling->sector->specialdata = ceiling;
 
-	    if (ceiling->thinker.function.acp1)
-		ceiling->thinker.function.acp1 = (actionf_p1)T_MoveCeiling;
+	if (ceiling->thinker.function.acp1)
+	    ceiling->thinker.function.acp1 = (actionf_p1)T_MoveCeiling;
 
-	    P_AddThinker (&ceiling->thinker);
-	    P_AddActiveCeiling(ceiling);
-	    break;
+	P_AddThinker (&ceiling->thinker);
+	P_AddActiveCeiling(ceiling);
+	break;
 				
-	  case tc_door:
-	    saveg_read_pad();
-	    door = Z_Malloc (sizeof(*door), PU_LEVEL, NULL);
-            saveg_read_vldoor_t(door);
-	    door->sector->specialdata = door;
-	    door->thinker.function.acp1 = (actionf_p1)T_VerticalDoor;
-	    P_AddThinker (&door->thinker);
-	    break;
+      case tc_door:
+	saveg_read_pad();
+	door = Z_PoolAlloc (&specialpool);
+        saveg_read_vldoor_t(door);
+	door->sector->specialdata = door;
+	door->thinker.function.acp1 = (actionf_p1)T_VerticalDoor;
+	P_AddThinker (&door->thinker);
+	break;
 				
-	  case tc_floor:
-	    saveg_read_pad();
-	    floor = Z_Malloc (sizeof(*floor), PU_LEVEL, NULL);
-            saveg_read_floormove_t(floor);
-	    floor->sector->specialdata = floor;
-	    floor->thinker.function.acp1 = (actionf_p1)T_MoveFloor;
-	    P_AddThinker (&floor->thinker);
-	    break;
+      case tc_floor:
+	saveg_read_pad();
+	floor = Z_PoolAlloc (&specialpool);
+        saveg_read_floormove_t(floor);
+	floor->sector->specialdata = floor;
+	floor->thinker.function.acp1 = (actionf_p1)T_MoveFloor;
+	P_AddThinker (&floor->thinker);
+	break;
 				
-	  case tc_plat:
-	    saveg_read_pad();
-	    plat = Z_Malloc (sizeof(*plat), PU_LEVEL, NULL);
-            saveg_read_plat_t(plat);
-	    plat->sector->specialdata = plat;
+      case tc_plat:
+	saveg_read_pad();
+	plat = Z_PoolAlloc (&specialpool);
+        saveg_read_plat_t(plat);
+	plat->sector->specialdata = plat;
 
-	    if (plat->thinker.function.acp1)
-		plat->thinker.function.acp1 = (actionf_p1)T_PlatRaise;
+	if (plat->thinker.function.acp1)
+	    plat->thinker.function.acp1 = (actionf_p1)T_PlatRaise;
 
-	    P_AddThinker (&plat->thinker);
-	    P_AddActivePlat(plat);
-	    break;
+	P_AddThinker (&plat->thinker);
+	P_AddActivePlat(plat);
+	break;
 				
-	  case tc_flash:
-	    saveg_read_pad();
-	    flash = Z_Malloc (sizeof(*flash), PU_LEVEL, NULL);
-            saveg_read_lightflash_t(flash);
-	    flash->thinker.function.acp1 = (actionf_p1)T_LightFlash;
-	    P_AddThinker (&flash->thinker);
-	    break;
+      case tc_flash:
+	saveg_read_pad();
+	flash = Z_PoolAlloc (&specialpool);
+        saveg_read_lightflash_t(flash);
+	flash->thinker.function.acp1 = (actionf_p1)T_LightFlash;
+	P_AddThinker (&flash->thinker);
+	break;
 				
-	  case tc_strobe:
-	    saveg_read_pad();
-	    strobe = Z_Malloc (sizeof(*strobe), PU_LEVEL, NULL);
-            saveg_read_strobe_t(strobe);
-	    strobe->thinker.function.acp1 = (actionf_p1)T_StrobeFlash;
-	    P_AddThinker (&strobe->thinker);
-	    break;
+      case tc_strobe:
+	saveg_read_pad();
+	strobe = Z_PoolAlloc (&specialpool);
+        saveg_read_strobe_t(strobe);
+	strobe->thinker.function.acp1 = (actionf_p1)T_StrobeFlash;
+	P_AddThinker (&strobe->thinker);
+	break;
 				
-	  case tc_glow:
-	    saveg_read_pad();
-	    glow = Z_Malloc (sizeof(*glow), PU_LEVEL, NULL);
-            saveg_read_glow_t(glow);
-	    glow->thinker.function.acp1 = (actionf_p1)T_Glow;
-	    P_AddThinker (&glow->thinker);
-	    break;
+      case tc_glow:
+	saveg_read_pad();
+	glow = Z_PoolAlloc (&specialpool);
+        saveg_read_glow_t(glow);
+	glow->thinker.function.acp1 = (actionf_p1)T_Glow;
+	P_AddThinker (&glow->thinker);
+	break;
+
+      case tc_fireflicker:
+	if (!saveg_snapshot)
+	    goto unknown;
+
+	saveg_read_pad();
+	flicker = Z_PoolAlloc (&specialpool);
+        saveg_read_fireflicker_t(flicker);
+	flicker->thinker.function.acp1 = (actionf_p1)T_FireFlicker;
+	P_AddThinker (&flicker->thinker);
+	break;
 				
-	  default:
-	    I_Error ("P_UnarchiveSpecials:Unknown tclass %i "
-		     "in savegame",tclass);
+      default:
+      unknown:
+	I_Error ("P_UnarchiveSpecials:Unknown tclass %i "
+		 "in savegame",tclass);
+    }
+}
+
+
+//
+// P_ArchiveSnapshot
+// What a snapshot needs on top of a savegame: the sector heights
+//  and texture offsets to the fraction, sound targets, pressed
+//  switches, the boss brain, the item respawn queue and the
+//  level timer.  Written after the specials.
+//
+void P_ArchiveSnapshot (void)
+{
+    int			i;
+    sector_t*		sec;
+    side_t*		si;
+    button_t*		button;
+
+    for (i=0, sec = sectors ; i<numsectors ; i++,sec++)
+    {
+	saveg_write32(sec->floorheight);
+	saveg_write32(sec->ceilingheight);
+	saveg_writemobj(sec->soundtarget);
+    }
+
+    for (i=0, si = sides ; i<numsides ; i++,si++)
+    {
+	saveg_write32(si->textureoffset);
+	saveg_write32(si->rowoffset);
+    }
+
+    for (i=0, button = buttonlist ; i<MAXBUTTONS ; i++,button++)
+    {
+	saveg_write32(button->line ? button->line - lines : -1);
+	saveg_write_enum(button->where);
+	saveg_write32(button->btexture);
+	saveg_write32(button->btimer);
+
+	// always the soundorg of a sector
+	if (button->soundorg)
+	{
+	    sec = (sector_t *) ((byte *) button->soundorg
+				- offsetof(sector_t, soundorg));
+	    saveg_write32(sec - sectors);
 	}
-	
+	else
+	    saveg_write32(-1);
+    }
+
+    saveg_write32(numbraintargets);
+    saveg_write32(braintargeton);
+    saveg_write32(brainspiteasy);
+
+    for (i=0 ; i<numbraintargets ; i++)
+	saveg_writemobj(braintargets[i]);
+
+    saveg_write32(iquehead);
+    saveg_write32(iquetail);
+
+    for (i=iquetail ; i!=iquehead ; i=(i+1)&(ITEMQUESIZE-1))
+    {
+	saveg_write_mapthing_t(&itemrespawnque[i]);
+	saveg_write32(itemrespawntime[i]);
     }
 
+    saveg_write32(levelTimeCount);
 }
 
 
+//
+// P_UnArchiveSnapshot
+// Also puts back the mobj pointers and the sector and blockmap
+//  chains in the order they were in, which decides who gets
+//  hit or picked up first.
+//
+void P_UnArchiveSnapshot (void)
+{
+    int			i;
+    int			index;
+    int			blockx;
+    int			blocky;
+    sector_t*		sec;
+    side_t*		si;
+    button_t*		button;
+    mobj_t*		mobj;
+
+    for (i=0, sec = sectors ; i<numsectors ; i++,sec++)
+    {
+	sec->floorheight = saveg_read32();
+	sec->ceilingheight = saveg_read32();
+	sec->soundtarget = saveg_relinkmobj(saveg_readp());
+	sec->oldfloorheight = sec->floorheight;
+	sec->oldceilingheight = sec->ceilingheight;
+    }
+
+    for (i=0, si = sides ; i<numsides ; i++,si++)
+    {
+	si->textureoffset = saveg_read32();
+	si->rowoffset = saveg_read32();
+    }
+
+    for (i=0, button = buttonlist ; i<MAXBUTTONS ; i++,button++)
+    {
+	index = saveg_read32();
+	button->line = index >= 0 ? &lines[index] : NULL;
+	button->where = saveg_read_enum();
+	button->btexture = saveg_read32();
+	button->btimer = saveg_read32();
+	index = saveg_read32();
+	button->soundorg = index >= 0 ? &sectors[index].soundorg : NULL;
+    }
+
+    numbraintargets = saveg_read32();
+    braintargeton = saveg_read32();
+    brainspiteasy = saveg_read32();
+
+    for (i=0 ; i<numbraintargets ; i++)
+	braintargets[i] = saveg_relinkmobj(saveg_readp());
+
+    iquehead = saveg_read32();
+    iquetail = saveg_read32();
+
+    for (i=iquetail ; i!=iquehead ; i=(i+1)&(ITEMQUESIZE-1))
+    {
+	saveg_read_mapthing_t(&itemrespawnque[i]);
+	itemrespawntime[i] = saveg_read32();
+    }
+
+    levelTimeCount = saveg_read32();
+
+    for (i=0 ; i<MAXPLAYERS ; i++)
+    {
+	if (playeringame[i])
+	    players[i].attacker = saveg_relinkmobj(players[i].attacker);
+    }
+
+    // the chains were emptied as the old mobjs were removed
+    for (i=0 ; i<numsnapmobjs ; i++)
+    {
+	mobj = snapmobjs[i];
+	mobj->target = saveg_relinkmobj(mobj->target);
+	mobj->tracer = saveg_relinkmobj(mobj->tracer);
+
+	if (mobj->flags & MF_NOSECTOR)
+	{
+	    mobj->snext = mobj->sprev = NULL;
+	}
+	else
+	{
+	    mobj->snext = saveg_relinkmobj(mobj->snext);
+	    mobj->sprev = saveg_relinkmobj(mobj->sprev);
+
+	    if (!mobj->sprev)
+		mobj->subsector->sector->thinglist = mobj;
+	}
+
+	if (mobj->flags & MF_NOBLOCKMAP)
+	{
+	    mobj->bnext = mobj->bprev = NULL;
+	}
+	else
+	{
+	    mobj->bnext = saveg_relinkmobj(mobj->bnext);
+	    mobj->bprev = saveg_relinkmobj(mobj->bprev);
+
+	    blockx = (mobj->x - bmaporgx)>>MAPBLOCKSHIFT;
+	    blocky = (mobj->y - bmaporgy)>>MAPBLOCKSHIFT;
+
+	    if (!mobj->bprev
+		&& blockx>=0 && blockx < bmapwidth
+		&& blocky>=0 && blocky < bmapheight)
+	    {
+		blocklinks[blocky*bmapwidth+blockx] = mobj;
+	    }
+	}
+    }
+
+    P_RelinkThingGrid ();
+}
+
+// Reads the whole file into the savegame buffer.
 boolean P_OpenSaveFileForReading(const char *path) {
-	return kinc_file_reader_open(&save_game.reader, path, KINC_FILE_TYPE_SAVE);
+	kinc_file_reader_t reader;
+	size_t size;
+
+	if (!kinc_file_reader_open(&reader, path, KINC_FILE_TYPE_SAVE)) {
+		return false;
+	}
+
+	size = kinc_file_reader_size(&reader);
+	saveg_reserve(size);
+	save_game.length = kinc_file_reader_read(&reader, save_game.buffer, size);
+	save_game.pos = 0;
+
+	kinc_file_reader_close(&reader);
+
+	return true;
 }
 
 void P_CloseSaveFileForReading(void) {
-	kinc_file_reader_close(&save_game.reader);
+	// the buffer is kept for the next savegame
+	save_game.length = 0;
+	save_game.pos = 0;
 }
 
 boolean P_ReadSaveGameName(void *target, int size) {
-	return kinc_file_reader_read(&save_game.reader, target, size);	
+	size_t count = save_game.length - save_game.pos;
+
+	if (count > (size_t) size) {
+		count = size;
+	}
+
+	memcpy(target, save_game.buffer + save_game.pos, count);
+	save_game.pos += count;
+
+	return count > 0;
 }
 
 boolean P_OpenSaveFileForWriting(const char *path) {
-	save_game.bytes_written = 0;
+	save_game.length = 0;
 	return kinc_file_writer_open(&save_game.writer, path);
 }
 
+// Flushes the serialized savegame with a single write.
 void P_CloseSaveFileForWriting(void) {
+	kinc_file_writer_write(&save_game.writer, save_game.buffer, (int) save_game.length);
 	kinc_file_writer_close(&save_game.writer);
+	save_game.length = 0;
+}
+
+void P_OpenSaveBufferForWriting(void) {
+	save_game.length = 0;
+	saveg_snapshot = true;
+	saveg_number_mobjs();
+}
+
+// Copies the serialized state out.  The copy only grows, with some
+// slack, so a snapshot taken every few tics settles on no allocations.
+void P_CloseSaveBufferForWriting(savebuffer_t *buffer) {
+	if (save_game.length > buffer->size) {
+		buffer->size = save_game.length + save_game.length / 4;
+		buffer->data = I_Realloc(buffer->data, buffer->size);
+	}
+
+	memcpy(buffer->data, save_game.buffer, save_game.length);
+	buffer->length = save_game.length;
+	save_game.length = 0;
+	saveg_snapshot = false;
+}
+
+void P_OpenSaveBufferForReading(savebuffer_t *buffer) {
+	saveg_reserve(buffer->length);
+	memcpy(save_game.buffer, buffer->data, buffer->length);
+	save_game.length = buffer->length;
+	save_game.pos = 0;
+	saveg_snapshot = true;
+}
+
+void P_CloseSaveBufferForReading(void) {
+	save_game.length = 0;
+	save_game.pos = 0;
+	saveg_snapshot = false;
+}
+
+void P_FreeSaveBuffer(savebuffer_t *buffer) {
+	free(buffer->data);
+	buffer->data = NULL;
+	buffer->size = 0;
+	buffer->length = 0;
 }
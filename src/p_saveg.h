@@ -27,6 +27,11 @@
 
 #define SAVESTRINGSIZE 24
 
+// vanilla's savegame size limit, also the initial size of the
+// savegame buffer, which most saves fit in.
+
+#define SAVEGAMESIZE 0x2c000
+
 // temporary filename to use while saving.
 
 char *P_TempSaveGameFile(void);
@@ -56,6 +61,10 @@ void P_UnArchiveThinkers (void);
 void P_ArchiveSpecials (void);
 void P_UnArchiveSpecials (void);
 
+// What snapshots keep on top of a savegame, after the specials.
+void P_ArchiveSnapshot (void);
+void P_UnArchiveSnapshot (void);
+
 
 boolean P_OpenSaveFileForReading (const char* path);
 void P_CloseSaveFileForReading (void);
@@ -64,6 +73,20 @@ boolean P_ReadSaveGameName(void* target, int size);
 boolean P_OpenSaveFileForWriting (const char* path);
 void P_CloseSaveFileForWriting (void);
 
+// Serialized state kept in memory instead of a file.
+typedef struct
+{
+    byte*	data;
+    size_t	size;		// bytes allocated
+    size_t	length;		// bytes of serialized state
+} savebuffer_t;
+
+void P_OpenSaveBufferForWriting (void);
+void P_CloseSaveBufferForWriting (savebuffer_t* buffer);
+void P_OpenSaveBufferForReading (savebuffer_t* buffer);
+void P_CloseSaveBufferForReading (void);
+void P_FreeSaveBuffer (savebuffer_t* buffer);
+
 extern boolean savegame_error;
 
 
@@ -533,6 +533,8 @@ void P_LoadBlockMap (int lump)
     count = sizeof(*blocklinks) * bmapwidth * bmapheight;
     blocklinks = Z_Malloc(count, PU_LEVEL, 0);
     memset(blocklinks, 0, count);
+
+    P_ClearThingGrid ();
 }
 
 
@@ -766,6 +768,9 @@ P_SetupLevel
     // Make sure all sounds are stopped before Z_FreeTags.
     S_Start ();			
 
+    // Nor may a -pipeline view be drawn from the old level.
+    R_ClearSnapshot ();
+
     Z_FreeTags (PU_LEVEL, PU_PURGELEVEL-1);
 
     // UNUSED W_Profile ();
@@ -846,6 +851,8 @@ P_SetupLevel
 //
 void P_Init (void)
 {
+    P_InitThinkerPools ();
+    P_InitThingGrid ();
     P_InitSwitchList ();
     P_InitPicAnims ();
     R_InitSprites (sprnames);
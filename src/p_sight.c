@@ -39,6 +39,36 @@ fixed_t		t2y;
 
 int		sightcounts[2];
 
+// Memo of P_CheckSight results.  The answer depends only on where
+//  the two things are and on the sector heights along the way, so
+//  entries are keyed on position and dropped, by bumping
+//  sightstamp, every tic and whenever a sector moves.
+#define SIGHTCACHESIZE	1024	// power of two
+#define SIGHTCACHEPROBE	8
+
+typedef struct
+{
+    fixed_t	x1, y1, z1, height1;
+    fixed_t	x2, y2, z2, height2;
+    int		stamp;
+    boolean	result;
+} sightentry_t;
+
+static sightentry_t	sightcache[SIGHTCACHESIZE];
+static int		sightstamp = 1;
+
+unsigned int		sightcachehits;
+unsigned int		sightcachemisses;
+
+
+//
+// P_ClearSightCache
+//
+void P_ClearSightCache (void)
+{
+    sightstamp++;
+}
+
 
 //
 // P_DivlineSide
@@ -307,6 +337,11 @@ P_CheckSight
     int		pnum;
     int		bytenum;
     int		bitnum;
+    int		i;
+    unsigned int hash;
+    sightentry_t*	entry;
+    sightentry_t*	slot;
+    boolean	result;
     
     // First check for trivial rejection.
 
@@ -326,6 +361,39 @@ P_CheckSight
 	return false;	
     }
 
+    // Seen already this tic?
+    hash = ((unsigned) t1->x ^ ((unsigned) t1->y * 31)
+	    ^ ((unsigned) t1->z * 17) ^ ((unsigned) t2->x * 7)
+	    ^ ((unsigned) t2->y * 13) ^ ((unsigned) t2->z * 29)) >> FRACBITS;
+    hash ^= hash >> 10;
+    slot = NULL;
+
+    for (i=0 ; i<SIGHTCACHEPROBE ; i++)
+    {
+	entry = &sightcache[(hash + i) & (SIGHTCACHESIZE-1)];
+
+	if (entry->stamp != sightstamp)
+	{
+	    if (!slot)
+		slot = entry;
+	    break;
+	}
+
+	if (entry->x1 == t1->x && entry->y1 == t1->y
+	 && entry->z1 == t1->z && entry->height1 == t1->height
+	 && entry->x2 == t2->x && entry->y2 == t2->y
+	 && entry->z2 == t2->z && entry->height2 == t2->height)
+	{
+	    sightcachehits++;
+	    return entry->result;
+	}
+    }
+
+    if (!slot)
+	slot = &sightcache[hash & (SIGHTCACHESIZE-1)];
+
+    sightcachemisses++;
+
     // An unobstructed LOS is possible.
     // Now look from eyes of t1 to any part of t2.
     sightcounts[1]++;
@@ -344,7 +412,20 @@ P_CheckSight
     strace.dy = t2->y - t1->y;
 
     // the head node is the last node output
-    return P_CrossBSPNode (numnodes-1);	
+    result = P_CrossBSPNode (numnodes-1);
+
+    slot->x1 = t1->x;
+    slot->y1 = t1->y;
+    slot->z1 = t1->z;
+    slot->height1 = t1->height;
+    slot->x2 = t2->x;
+    slot->y2 = t2->y;
+    slot->z2 = t2->z;
+    slot->height2 = t2->height;
+    slot->stamp = sightstamp;
+    slot->result = result;
+
+    return result;
 }
 
 
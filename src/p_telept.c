@@ -108,6 +108,9 @@ EV_Teleport
 		if (thing->player)
 		    thing->player->viewz = thing->z+thing->player->viewheight;
 
+		// no sliding across the map between tics
+		thing->interp = false;
+
 		// spawn teleport fog at source and destination
 		fog = P_SpawnMobj (oldx, oldy, oldz, MT_TFOG);
 		S_StartSound (fog, sfx_telept);
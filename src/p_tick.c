@@ -18,7 +18,12 @@
 //
 
 
+#include <stdio.h>
+
 #include "z_zone.h"
+#include "i_system.h"
+#include "m_argv.h"
+#include "m_bench.h"
 #include "p_local.h"
 
 #include "doomstat.h"
@@ -28,7 +33,7 @@ int	leveltime;
 
 //
 // THINKERS
-// All thinkers should be allocated by Z_Malloc
+// All thinkers should be allocated by Z_PoolAlloc
 // so they can be operated on uniformly.
 // The actual structures will vary in size,
 // but the first element must be thinker_t.
@@ -39,13 +44,149 @@ int	leveltime;
 // Both the head and tail of the thinker list.
 thinker_t	thinkercap;
 
+// Mobjs and sector specials come out of slab pools, so
+//  thinkers spawned together are next to each other.
+zpool_t		mobjpool;
+zpool_t		specialpool;
+
+#define MOBJSPERSLAB		128
+#define SPECIALSPERSLAB		64
+
+// The largest sector special decides the special pool's size.
+typedef union
+{
+    ceiling_t		ceiling;
+    vldoor_t		door;
+    floormove_t		floor;
+    plat_t		plat;
+    fireflicker_t	flicker;
+    lightflash_t	flash;
+    strobe_t		strobe;
+    glow_t		glow;
+} specialthinker_t;
+
+
+//
+// THINKER BUCKETS
+// With -thinkerbuckets, P_RunThinkers runs all thinkers of one
+// kind in a row, each kind from a dense array, instead of walking
+// the list.  That is not the vanilla order, so demos desync.
+//
+// The list stays the real set of thinkers; the buckets only
+// decide who runs when.  Spawners set the function after
+// P_AddThinker, so new thinkers wait in the pending bucket until
+// P_RunThinkers sorts them by their function.  A thinker whose
+// function changes afterwards still runs through its pointer.
+//
+
+typedef enum
+{
+    tb_mobj,
+    tb_floor,
+    tb_ceiling,
+    tb_door,
+    tb_plat,
+    tb_flicker,
+    tb_flash,
+    tb_strobe,
+    tb_glow,
+    tb_other,		// anything else, run through the pointer
+
+    NUMTHINKERBUCKETS
+} thinkerbucketnum_t;
+
+typedef struct
+{
+    thinker_t**		items;
+    int			count;
+    int			max;
+    int			done;	// items already run this tic
+} thinkerbucket_t;
+
+boolean			thinkerbuckets;
+
+static thinkerbucket_t	buckets[NUMTHINKERBUCKETS];
+static thinkerbucket_t	pending;
+
+
+static void P_BucketAdd (thinkerbucket_t* bucket, thinker_t* thinker)
+{
+    if (bucket->count == bucket->max)
+    {
+	bucket->max = bucket->max ? bucket->max * 2 : 256;
+	bucket->items = I_Realloc (bucket->items,
+				   bucket->max * sizeof(*bucket->items));
+    }
+
+    bucket->items[bucket->count++] = thinker;
+}
+
+
+static thinkerbucketnum_t P_BucketFor (thinker_t* thinker)
+{
+    actionf_p1	func = thinker->function.acp1;
+
+    if (func == (actionf_p1) P_MobjThinker)
+	return tb_mobj;
+    if (func == (actionf_p1) T_MoveFloor)
+	return tb_floor;
+    if (func == (actionf_p1) T_MoveCeiling)
+	return tb_ceiling;
+    if (func == (actionf_p1) T_VerticalDoor)
+	return tb_door;
+    if (func == (actionf_p1) T_PlatRaise)
+	return tb_plat;
+    if (func == (actionf_p1) T_FireFlicker)
+	return tb_flicker;
+    if (func == (actionf_p1) T_LightFlash)
+	return tb_flash;
+    if (func == (actionf_p1) T_StrobeFlash)
+	return tb_strobe;
+    if (func == (actionf_p1) T_Glow)
+	return tb_glow;
+
+    return tb_other;
+}
+
+
+//
+// P_InitThinkerPools
+// Only at game startup.
+//
+void P_InitThinkerPools (void)
+{
+    Z_PoolInit (&mobjpool, sizeof(mobj_t), MOBJSPERSLAB, PU_LEVEL);
+    Z_PoolInit (&specialpool, sizeof(specialthinker_t),
+		SPECIALSPERSLAB, PU_LEVSPEC);
+
+    //!
+    // @category game
+    //
+    // Run the thinkers grouped by kind rather than in the order
+    // they were spawned.  Faster on busy maps, but demos desync.
+    //
+
+    thinkerbuckets = M_CheckParm ("-thinkerbuckets") > 0;
+
+    if (thinkerbuckets)
+	printf ("P_InitThinkerPools: thinkers run in buckets, "
+		"demos will not play back correctly\n");
+}
+
 
 //
 // P_InitThinkers
 //
 void P_InitThinkers (void)
 {
+    int		i;
+
     thinkercap.prev = thinkercap.next  = &thinkercap;
+
+    for (i=0 ; i<NUMTHINKERBUCKETS ; i++)
+	buckets[i].count = 0;
+
+    pending.count = 0;
 }
 
 
@@ -61,6 +202,9 @@ void P_AddThinker (thinker_t* thinker)
     thinker->next = &thinkercap;
     thinker->prev = thinkercap.prev;
     thinkercap.prev = thinker;
+
+    if (thinkerbuckets)
+	P_BucketAdd (&pending, thinker);
 }
 
 
@@ -88,6 +232,124 @@ void P_AllocateThinker (thinker_t*	thinker)
 
 
 
+//
+// P_FreeBucketItem
+// Frees a removed thinker and moves the last one in its place.
+//
+static void P_FreeBucketItem (thinkerbucket_t* bucket, int index)
+{
+    thinker_t*	th = bucket->items[index];
+
+    th->next->prev = th->prev;
+    th->prev->next = th->next;
+    Z_PoolFree (th);
+
+    bucket->items[index] = bucket->items[--bucket->count];
+}
+
+
+//
+// P_Run*Bucket
+// Runs the thinkers of a bucket not yet run this tic, calling
+//  the bucket's function directly.
+//
+#define RUNBUCKET(name, func, type)					\
+static void name (thinkerbucket_t* bucket)				\
+{									\
+    thinker_t*	th;							\
+									\
+    while (bucket->done < bucket->count)				\
+    {									\
+	th = bucket->items[bucket->done];				\
+									\
+	if (th->function.acp1 == (actionf_p1) func)			\
+	    func ((type *) th);						\
+	else if (th->function.acv == (actionf_v)(-1))			\
+	{								\
+	    P_FreeBucketItem (bucket, bucket->done);			\
+	    continue;							\
+	}								\
+	else if (th->function.acp1)					\
+	    th->function.acp1 (th);					\
+									\
+	bucket->done++;							\
+    }									\
+}
+
+RUNBUCKET (P_RunMobjBucket, P_MobjThinker, mobj_t)
+RUNBUCKET (P_RunFloorBucket, T_MoveFloor, floormove_t)
+RUNBUCKET (P_RunCeilingBucket, T_MoveCeiling, ceiling_t)
+RUNBUCKET (P_RunDoorBucket, T_VerticalDoor, vldoor_t)
+RUNBUCKET (P_RunPlatBucket, T_PlatRaise, plat_t)
+RUNBUCKET (P_RunFlickerBucket, T_FireFlicker, fireflicker_t)
+RUNBUCKET (P_RunFlashBucket, T_LightFlash, lightflash_t)
+RUNBUCKET (P_RunStrobeBucket, T_StrobeFlash, strobe_t)
+RUNBUCKET (P_RunGlowBucket, T_Glow, glow_t)
+
+static void P_RunOtherBucket (thinkerbucket_t* bucket)
+{
+    thinker_t*	th;
+
+    while (bucket->done < bucket->count)
+    {
+	th = bucket->items[bucket->done];
+
+	if (th->function.acv == (actionf_v)(-1))
+	{
+	    P_FreeBucketItem (bucket, bucket->done);
+	    continue;
+	}
+	else if (th->function.acp1)
+	    th->function.acp1 (th);
+
+	bucket->done++;
+    }
+}
+
+static void (*const runbucket[NUMTHINKERBUCKETS]) (thinkerbucket_t*) =
+{
+    P_RunMobjBucket,
+    P_RunFloorBucket,
+    P_RunCeilingBucket,
+    P_RunDoorBucket,
+    P_RunPlatBucket,
+    P_RunFlickerBucket,
+    P_RunFlashBucket,
+    P_RunStrobeBucket,
+    P_RunGlowBucket,
+    P_RunOtherBucket,
+};
+
+
+//
+// P_RunThinkerBuckets
+// Thinkers spawned while running go to pending, and are sorted
+//  and run before the tic ends, as they would be in the list.
+//
+static void P_RunThinkerBuckets (void)
+{
+    int		i;
+    boolean	more;
+
+    for (i=0 ; i<NUMTHINKERBUCKETS ; i++)
+	buckets[i].done = 0;
+
+    do
+    {
+	for (i=0 ; i<pending.count ; i++)
+	    P_BucketAdd (&buckets[P_BucketFor (pending.items[i])],
+			 pending.items[i]);
+
+	pending.count = 0;
+
+	for (i=0 ; i<NUMTHINKERBUCKETS ; i++)
+	    runbucket[i] (&buckets[i]);
+
+	more = pending.count > 0;
+    } while (more);
+}
+
+
 //
 // P_RunThinkers
 //
@@ -95,6 +357,12 @@ void P_RunThinkers (void)
 {
     thinker_t*	currentthinker;
 
+    if (thinkerbuckets)
+    {
+	P_RunThinkerBuckets ();
+	return;
+    }
+
     currentthinker = thinkercap.next;
     while (currentthinker != &thinkercap)
     {
@@ -103,7 +371,7 @@ void P_RunThinkers (void)
 	    // time to remove it
 	    currentthinker->next->prev = currentthinker->prev;
 	    currentthinker->prev->next = currentthinker->next;
-	    Z_Free (currentthinker);
+	    Z_PoolFree (currentthinker);
 	}
 	else
 	{
@@ -116,6 +384,44 @@ void P_RunThinkers (void)
 
 
 
+//
+// P_StoreInterpolations
+// Remembers where things, views and planes are before a tic
+// runs, so -uncapped can draw the frames in between.  Things
+// spawned or teleported during the tic are drawn where they are.
+//
+void P_StoreInterpolations (void)
+{
+    thinker_t*	th;
+    mobj_t*	mo;
+    sector_t*	sec;
+    int		i;
+
+    for (th = thinkercap.next ; th != &thinkercap ; th = th->next)
+    {
+	if (th->function.acp1 != (actionf_p1) P_MobjThinker)
+	    continue;
+
+	mo = (mobj_t *) th;
+	mo->oldx = mo->x;
+	mo->oldy = mo->y;
+	mo->oldz = mo->z;
+	mo->oldangle = mo->angle;
+	mo->interp = true;
+    }
+
+    for (i=0 ; i<MAXPLAYERS ; i++)
+	players[i].oldviewz = players[i].viewz;
+
+    for (i=0, sec=sectors ; i<numsectors ; i++, sec++)
+    {
+	sec->oldfloorheight = sec->floorheight;
+	sec->oldceilingheight = sec->ceilingheight;
+    }
+}
+
+
+
 //
 // P_Ticker
 //
@@ -137,12 +443,15 @@ void P_Ticker (void)
 	return;
     }
     
+    P_ClearSightCache ();
 		
     for (i=0 ; i<MAXPLAYERS ; i++)
 	if (playeringame[i])
 	    P_PlayerThink (&players[i]);
 			
+    M_BenchBegin (bench_thinkers);
     P_RunThinkers ();
+    M_BenchEnd (bench_thinkers);
     P_UpdateSpecials ();
     P_RespawnSpecials ();
 
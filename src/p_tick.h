@@ -28,6 +28,9 @@
 // Carries out all thinking of monsters and players.
 void P_Ticker (void);
 
+// Called before P_Ticker when drawing between tics.
+void P_StoreInterpolations (void);
+
 
 
 #endif
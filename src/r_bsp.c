@@ -43,8 +43,9 @@ line_t*		linedef;
 sector_t*	frontsector;
 sector_t*	backsector;
 
-drawseg_t	drawsegs[MAXDRAWSEGS];
+drawseg_t*	drawsegs;
 drawseg_t*	ds_p;
+static int	maxdrawsegs;
 
 
 void
@@ -64,6 +65,27 @@ void R_ClearDrawSegs (void)
 }
 
 
+//
+// R_CheckDrawSegs
+// Makes room for one more drawseg.  Nothing holds on to
+//  drawseg pointers while the BSP is walked, so the array
+//  is free to move.
+//
+void R_CheckDrawSegs (void)
+{
+    int		used;
+
+    used = ds_p - drawsegs;
+
+    if (used < maxdrawsegs)
+	return;
+
+    maxdrawsegs = maxdrawsegs ? maxdrawsegs * 2 : MAXDRAWSEGS;
+    drawsegs = I_Realloc (drawsegs, maxdrawsegs * sizeof(*drawsegs));
+    ds_p = drawsegs + used;
+}
+
+
 
 //
 // ClipWallSegment
@@ -78,7 +100,10 @@ typedef	struct
 } cliprange_t;
 
 
-#define MAXSEGS		32
+// Solid ranges are separated by at least one open column, so
+//  there are never more than half the view width of them, plus
+//  the two sentinels.
+#define MAXSEGS		(SCREENWIDTH / 2 + 3)
 
 // newend is one past the last valid seg
 cliprange_t*	newend;
@@ -501,10 +526,10 @@ void R_Subsector (int num)
 #endif
 
     sscount++;
-    sub = &subsectors[num];
+    sub = &viewsubsectors[num];
     frontsector = sub->sector;
     count = sub->numlines;
-    line = &segs[sub->firstline];
+    line = &viewsegs[sub->firstline];
 
     if (frontsector->floorheight < viewz)
     {
@@ -239,6 +239,11 @@ void R_GenerateComposite (int texnum)
 	
     texture = textures[texnum];
 
+    // The allocation may purge other composites that queued
+    // columns still point into.
+    if (numdrawthreads > 1)
+	R_FlushDrawQueue ();
+
     block = Z_Malloc (texturecompositesize[texnum],
 		      PU_STATIC, 
 		      &texturecomposite[texnum]);	
@@ -789,6 +794,36 @@ int	R_TextureNumForName (char* name)
 
 
 
+//
+// R_LockComposites
+// Builds every composite texture and keeps them all static,
+//  for renderers that draw while the playsim allocates
+//  (and may purge) zone memory.
+//
+void R_LockComposites (void)
+{
+    int		i;
+    int		size;
+
+    size = 0;
+
+    for (i=0 ; i<numtextures ; i++)
+    {
+	if (!texturecompositesize[i])
+	    continue;
+
+	if (!texturecomposite[i])
+	    R_GenerateComposite (i);
+
+	Z_ChangeTag (texturecomposite[i], PU_STATIC);
+	size += texturecompositesize[i];
+    }
+
+    printf ("R_LockComposites: %ik of composite textures\n", size >> 10);
+}
+
+
+
 //
 // R_PrecacheLevel
 // Preloads all relevant graphics for the level.
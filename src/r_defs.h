@@ -48,6 +48,7 @@
 #define SIL_TOP			2
 #define SIL_BOTH		3
 
+// Initial size of the drawseg array, which grows as needed.
 #define MAXDRAWSEGS		256
 
 
@@ -127,6 +128,10 @@ typedef	struct
 
     int			linecount;
     struct line_s**	lines;	// [linecount] size
+
+    // heights at the end of the last tic, for -uncapped
+    fixed_t	oldfloorheight;
+    fixed_t	oldceilingheight;
     
 } sector_t;
 
@@ -420,8 +425,11 @@ typedef struct
 //
 // Now what is a visplane, anyway?
 // 
-typedef struct
+typedef struct visplane_s
 {
+  // next plane in the same R_FindPlane hash chain
+  struct visplane_s*	next;
+
   fixed_t		height;
   int			picnum;
   int			lightlevel;
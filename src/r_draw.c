@@ -24,7 +24,14 @@
 #include "doomdef.h"
 #include "deh_main.h"
 
+#include <stdlib.h>
+
+#include <kinc/threads/semaphore.h>
+#include <kinc/threads/thread.h>
+
 #include "i_system.h"
+#include "m_argv.h"
+#include "m_bench.h"
 #include "z_zone.h"
 #include "w_wad.h"
 
@@ -766,6 +773,416 @@ void R_DrawSpanLow (void)
     } while (count--);
 }
 
+
+//
+// PARALLEL DRAWING
+//
+// With -renderthreads, colfunc and spanfunc only record what they
+// would have drawn.  The queue is replayed once per frame (or when it
+// fills up) by all threads at once, each one owning a vertical strip
+// of the view.  Every column lies in exactly one strip and spans are
+// cut at the strip edges, so the order of writes to any one pixel is
+// the same as when drawing directly and the output is bit-identical.
+//
+// Anything the recorded columns point to must stay put until the
+// queue is flushed; see R_GenerateComposite and R_InitDrawThreads.
+//
+
+#define MAXDRAWTHREADS		16
+#define DRAWQUEUESIZE		8192
+
+typedef enum
+{
+    DRAW_COLUMN,
+    DRAW_FUZZCOLUMN,
+    DRAW_TRANSCOLUMN,
+    DRAW_SPAN
+} drawkind_t;
+
+typedef struct
+{
+    drawkind_t		kind;
+
+    // columns: x1 == x2, rows y1 to y2
+    // spans: row y1, x1 to x2
+    int			x1, x2;
+    int			y1, y2;
+
+    // column texture position, or fuzzpos for fuzz columns
+    fixed_t		frac;
+    fixed_t		fracstep;
+
+    // packed span texture position, see R_DrawSpan
+    unsigned int	position;
+    unsigned int	step;
+
+    byte*		source;
+    lighttable_t*	colormap;
+    byte*		translation;
+} drawcmd_t;
+
+typedef struct
+{
+    kinc_thread_t	thread;
+    kinc_semaphore_t	start;
+    int			x1, x2;
+} drawthread_t;
+
+int			numdrawthreads = 1;
+
+static drawthread_t	drawthreads[MAXDRAWTHREADS];
+static kinc_semaphore_t	drawdone;
+
+static drawcmd_t*	drawqueue;
+static int		numqueued;
+
+
+static void DrawQueuedColumn (drawcmd_t *cmd)
+{
+    int			count;
+    byte*		dest;
+    byte*		dest2;
+    fixed_t		frac;
+    int			fuzz;
+    int			x;
+
+    count = cmd->y2 - cmd->y1;
+    frac = cmd->frac;
+    x = detailshift ? cmd->x1 << 1 : cmd->x1;
+
+    dest = ylookup[cmd->y1] + columnofs[x];
+    dest2 = ylookup[cmd->y1] + columnofs[x+1];
+
+    switch (cmd->kind)
+    {
+      case DRAW_COLUMN:
+	do
+	{
+	    *dest = cmd->colormap[cmd->source[(frac>>FRACBITS)&127]];
+
+	    if (detailshift)
+	    {
+		*dest2 = *dest;
+		dest2 += SCREENWIDTH;
+	    }
+
+	    dest += SCREENWIDTH;
+	    frac += cmd->fracstep;
+	} while (count--);
+	break;
+
+      case DRAW_FUZZCOLUMN:
+	fuzz = frac;
+
+	do
+	{
+	    *dest = colormaps[6*256+dest[fuzzoffset[fuzz]]];
+
+	    if (detailshift)
+	    {
+		*dest2 = colormaps[6*256+dest2[fuzzoffset[fuzz]]];
+		dest2 += SCREENWIDTH;
+	    }
+
+	    if (++fuzz == FUZZTABLE)
+		fuzz = 0;
+
+	    dest += SCREENWIDTH;
+	} while (count--);
+	break;
+
+      case DRAW_TRANSCOLUMN:
+	do
+	{
+	    *dest = cmd->colormap[cmd->translation[cmd->source[frac>>FRACBITS]]];
+
+	    if (detailshift)
+	    {
+		*dest2 = *dest;
+		dest2 += SCREENWIDTH;
+	    }
+
+	    dest += SCREENWIDTH;
+	    frac += cmd->fracstep;
+	} while (count--);
+	break;
+
+      default:
+	break;
+    }
+}
+
+
+static void DrawQueuedSpan (drawcmd_t *cmd, int x1, int x2)
+{
+    unsigned int	position;
+    unsigned int	xtemp, ytemp;
+    byte*		dest;
+    int			count;
+    int			spot;
+
+    // Clip to the strip.  The packed position only ever has the step
+    // added to it, so it can be advanced to the first pixel directly.
+    if (x1 < cmd->x1)
+	x1 = cmd->x1;
+
+    if (x2 > cmd->x2)
+	x2 = cmd->x2;
+
+    if (x1 > x2)
+	return;
+
+    position = cmd->position + (x1 - cmd->x1) * cmd->step;
+    count = x2 - x1;
+
+    dest = ylookup[cmd->y1] + columnofs[detailshift ? x1 << 1 : x1];
+
+    do
+    {
+	ytemp = (position >> 4) & 0x0fc0;
+	xtemp = (position >> 26);
+	spot = xtemp | ytemp;
+
+	*dest++ = cmd->colormap[cmd->source[spot]];
+
+	if (detailshift)
+	    *dest++ = cmd->colormap[cmd->source[spot]];
+
+	position += cmd->step;
+    } while (count--);
+}
+
+
+// Replay the queue for view columns x1 to x2 inclusive.
+
+static void DrawStrip (int x1, int x2)
+{
+    drawcmd_t*		cmd;
+    drawcmd_t*		end;
+
+    end = drawqueue + numqueued;
+
+    for (cmd = drawqueue; cmd < end; cmd++)
+    {
+	if (cmd->kind == DRAW_SPAN)
+	    DrawQueuedSpan (cmd, x1, x2);
+	else if (cmd->x1 >= x1 && cmd->x1 <= x2)
+	    DrawQueuedColumn (cmd);
+    }
+}
+
+
+static void DrawThread (void *param)
+{
+    drawthread_t*	thread = param;
+
+    for (;;)
+    {
+	kinc_semaphore_wait (&thread->start);
+	DrawStrip (thread->x1, thread->x2);
+	kinc_semaphore_signal (&drawdone);
+    }
+}
+
+
+//
+// R_FlushDrawQueue
+// Draws everything queued so far and waits for all threads to finish.
+//
+void R_FlushDrawQueue (void)
+{
+    int			i;
+
+    if (numqueued == 0)
+	return;
+
+    M_BenchBegin (bench_draw);
+
+    for (i = 1; i < numdrawthreads; i++)
+    {
+	drawthreads[i].x1 = (viewwidth * i) / numdrawthreads;
+	drawthreads[i].x2 = (viewwidth * (i + 1)) / numdrawthreads - 1;
+	kinc_semaphore_signal (&drawthreads[i].start);
+    }
+
+    // The calling thread takes the first strip.
+    DrawStrip (0, viewwidth / numdrawthreads - 1);
+
+    for (i = 1; i < numdrawthreads; i++)
+	kinc_semaphore_wait (&drawdone);
+
+    numqueued = 0;
+
+    M_BenchEnd (bench_draw);
+}
+
+
+static drawcmd_t *NewDrawCmd (drawkind_t kind)
+{
+    drawcmd_t*		cmd;
+
+    if (numqueued == DRAWQUEUESIZE)
+	R_FlushDrawQueue ();
+
+    cmd = &drawqueue[numqueued++];
+    cmd->kind = kind;
+
+    return cmd;
+}
+
+
+//
+// R_QueueColumn
+// Queued counterparts of R_DrawColumn, R_DrawFuzzColumn,
+//  R_DrawTranslatedColumn and R_DrawSpan (and the low detail
+//  versions), with the same range checks and side effects.
+//
+static void QueueColumn (drawkind_t kind)
+{
+    drawcmd_t*		cmd;
+
+    if (dc_yh < dc_yl)
+	return;
+
+#ifdef RANGECHECK
+    if ((unsigned)(dc_x << detailshift) >= SCREENWIDTH
+	|| dc_yl < 0
+	|| dc_yh >= SCREENHEIGHT)
+	I_Error ("R_DrawColumn: %i to %i at %i", dc_yl, dc_yh, dc_x);
+#endif
+
+    cmd = NewDrawCmd (kind);
+    cmd->x1 = cmd->x2 = dc_x;
+    cmd->y1 = dc_yl;
+    cmd->y2 = dc_yh;
+    cmd->frac = dc_texturemid + (dc_yl-centery)*dc_iscale;
+    cmd->fracstep = dc_iscale;
+    cmd->source = dc_source;
+    cmd->colormap = dc_colormap;
+    cmd->translation = dc_translation;
+}
+
+void R_QueueColumn (void)
+{
+    QueueColumn (DRAW_COLUMN);
+}
+
+void R_QueueTranslatedColumn (void)
+{
+    QueueColumn (DRAW_TRANSCOLUMN);
+}
+
+void R_QueueFuzzColumn (void)
+{
+    drawcmd_t*		cmd;
+
+    // Adjust borders, as R_DrawFuzzColumn does.
+    if (!dc_yl)
+	dc_yl = 1;
+
+    if (dc_yh == viewheight-1)
+	dc_yh = viewheight - 2;
+
+    if (dc_yh < dc_yl)
+	return;
+
+    QueueColumn (DRAW_FUZZCOLUMN);
+
+    // The fuzz pattern carries on from one column to the next, so
+    // remember where this one starts.
+    cmd = &drawqueue[numqueued - 1];
+    cmd->frac = fuzzpos;
+    fuzzpos = (fuzzpos + dc_yh - dc_yl + 1) % FUZZTABLE;
+}
+
+void R_QueueSpan (void)
+{
+    drawcmd_t*		cmd;
+
+#ifdef RANGECHECK
+    if (ds_x2 < ds_x1
+	|| ds_x1<0
+	|| (ds_x2 << detailshift)>=SCREENWIDTH
+	|| (unsigned)ds_y>SCREENHEIGHT)
+    {
+	I_Error( "R_DrawSpan: %i to %i at %i",
+		 ds_x1,ds_x2,ds_y);
+    }
+#endif
+
+    cmd = NewDrawCmd (DRAW_SPAN);
+    cmd->x1 = ds_x1;
+    cmd->x2 = ds_x2;
+    cmd->y1 = cmd->y2 = ds_y;
+    cmd->position = ((ds_xfrac << 10) & 0xffff0000)
+		  | ((ds_yfrac >> 6)  & 0x0000ffff);
+    cmd->step = ((ds_xstep << 10) & 0xffff0000)
+	      | ((ds_ystep >> 6)  & 0x0000ffff);
+    cmd->source = ds_source;
+    cmd->colormap = ds_colormap;
+}
+
+
+//
+// R_InitDrawThreads
+//
+void R_InitDrawThreads (void)
+{
+    int			i;
+    int			p;
+
+    //!
+    // @arg <n>
+    //
+    // Draw walls, flats and sprites on n threads (default 1).
+    // The output is identical to drawing on one thread.
+    //
+
+    p = M_CheckParmWithArgs ("-renderthreads", 1);
+
+    if (p == 0)
+	return;
+
+    numdrawthreads = atoi (myargv[p+1]);
+
+    if (numdrawthreads < 1)
+	numdrawthreads = 1;
+
+    if (numdrawthreads > MAXDRAWTHREADS)
+	numdrawthreads = MAXDRAWTHREADS;
+
+    // Queued columns point straight into lump data.  Lumps read into
+    // the zone could be purged before the queue is flushed, so only
+    // allow this when every lump is mapped.
+    for (i = 0; i < numlumps; i++)
+    {
+	if (lumpinfo[i].wad_file->mapped == NULL)
+	{
+	    printf ("R_InitDrawThreads: %.8s is not memory mapped, "
+		    "drawing on one thread\n", lumpinfo[i].name);
+	    numdrawthreads = 1;
+	    return;
+	}
+    }
+
+    if (numdrawthreads == 1)
+	return;
+
+    drawqueue = Z_Malloc (DRAWQUEUESIZE * sizeof(*drawqueue), PU_STATIC, 0);
+
+    kinc_semaphore_init (&drawdone, 0, numdrawthreads);
+
+    for (i = 1; i < numdrawthreads; i++)
+    {
+	kinc_semaphore_init (&drawthreads[i].start, 0, 1);
+	kinc_thread_init (&drawthreads[i].thread, DrawThread, &drawthreads[i]);
+    }
+
+    printf ("R_InitDrawThreads: drawing on %i threads\n", numdrawthreads);
+}
+
+
+
 //
 // R_InitBuffer 
 // Creats lookup tables that avoid
@@ -93,6 +93,19 @@ void	R_InitTranslationTables (void);
 
 
 
+// Parallel drawing, see -renderthreads.
+// The queue functions stand in for colfunc and spanfunc.
+extern int		numdrawthreads;
+
+void	R_InitDrawThreads (void);
+void	R_QueueColumn (void);
+void	R_QueueFuzzColumn (void);
+void	R_QueueTranslatedColumn (void);
+void	R_QueueSpan (void);
+void	R_FlushDrawQueue (void);
+
+
+
 // Rendering function.
 void R_FillBackScreen (void);
 
@@ -28,8 +28,10 @@
 
 #include "doomdef.h"
 #include "d_loop.h"
+#include "i_system.h"
 
 #include "m_bbox.h"
+#include "m_bench.h"
 #include "m_menu.h"
 
 #include "r_local.h"
@@ -61,7 +63,10 @@ fixed_t			centeryfrac;
 fixed_t			projection;
 
 // just for profiling purposes
-int			framecount;	
+int			framecount;
+
+renderusage_t		frameusage;
+renderusage_t		peakusage;	
 
 int			sscount;
 int			linecount;
@@ -78,6 +83,24 @@ fixed_t			viewsin;
 
 player_t*		viewplayer;
 
+// The level being drawn: the playsim's own arrays,
+//  or a snapshot of them with -pipeline (see r_snap.c).
+seg_t*			viewsegs;
+subsector_t*		viewsubsectors;
+int*			viewtexturetranslation;
+int*			viewflattranslation;
+
+// stamped on sectors whose sprites have been added
+int			viewvalidcount;
+
+// How far between the last tic and the current one to draw,
+//  for -uncapped.  FRACUNIT draws the current tic as is.
+fixed_t			fractionaltic = FRACUNIT;
+
+// real sector heights while interpolated ones are drawn
+static fixed_t*		realheights;
+static int		maxrealheights;
+
 // 0 = high, 1 = low
 int			detailshift;	
 
@@ -268,18 +291,20 @@ R_PointOnSegSide
 //  tantoangle[] table.
 
 //
+// PointToAngle works on a vector; R_PointToAngle measures from the
+//  view point, R_PointToAngle2 between two points.  The latter no
+//  longer goes through viewx/viewy, which the playsim must not touch
+//  while a -pipeline view is being drawn.
+//
 
 
 
 
-angle_t
-R_PointToAngle
+static angle_t
+PointToAngle
 ( fixed_t	x,
   fixed_t	y )
 {	
-    x -= viewx;
-    y -= viewy;
-    
     if ( (!x) && (!y) )
 	return 0;
 
@@ -358,6 +383,15 @@ R_PointToAngle
 }
 
 
+angle_t
+R_PointToAngle
+( fixed_t	x,
+  fixed_t	y )
+{	
+    return PointToAngle (x - viewx, y - viewy);
+}
+
+
 angle_t
 R_PointToAngle2
 ( fixed_t	x1,
@@ -365,10 +399,7 @@ R_PointToAngle2
   fixed_t	x2,
   fixed_t	y2 )
 {	
-    viewx = x1;
-    viewy = y1;
-    
-    return R_PointToAngle (x2, y2);
+    return PointToAngle (x2 - x1, y2 - y1);
 }
 
 
@@ -710,6 +741,15 @@ void R_ExecuteSetViewSize (void)
 	spanfunc = R_DrawSpanLow;
     }
 
+    if (numdrawthreads > 1)
+    {
+	// The queued versions handle both detail levels.
+	colfunc = basecolfunc = R_QueueColumn;
+	fuzzcolfunc = R_QueueFuzzColumn;
+	transcolfunc = R_QueueTranslatedColumn;
+	spanfunc = R_QueueSpan;
+    }
+
     R_InitBuffer (scaledviewwidth, viewheight);
 	
     R_InitTextureMapping ();
@@ -782,6 +822,7 @@ void R_Init (void)
     R_InitSkyMap ();
     R_InitTranslationTables ();
     printf (".");
+    R_InitDrawThreads ();
 	
     framecount = 0;
 }
@@ -831,6 +872,19 @@ void R_SetupFrame (player_t* player)
     extralight = player->extralight;
 
     viewz = player->viewz;
+
+    if (fractionaltic != FRACUNIT && player->mo->interp)
+    {
+	viewx = player->mo->oldx
+	      + FixedMul (player->mo->x - player->mo->oldx, fractionaltic);
+	viewy = player->mo->oldy
+	      + FixedMul (player->mo->y - player->mo->oldy, fractionaltic);
+	viewangle = player->mo->oldangle + viewangleoffset
+		  + FixedMul ((int) (player->mo->angle - player->mo->oldangle),
+			      fractionaltic);
+	viewz = player->oldviewz
+	      + FixedMul (player->viewz - player->oldviewz, fractionaltic);
+    }
     
     viewsin = finesine[viewangle>>ANGLETOFINESHIFT];
     viewcos = finecosine[viewangle>>ANGLETOFINESHIFT];
@@ -852,15 +906,38 @@ void R_SetupFrame (player_t* player)
 	fixedcolormap = 0;
 		
     framecount++;
-    validcount++;
+}
+
+
+
+//
+// R_RecordUsage
+//
+static void R_RecordUsage (void)
+{
+    frameusage.visplanes = numvisplanes;
+    frameusage.drawsegs = ds_p - drawsegs;
+    frameusage.vissprites = vissprite_p - vissprites;
+    frameusage.openings = lastopening - openings;
+
+    if (frameusage.visplanes > peakusage.visplanes)
+	peakusage.visplanes = frameusage.visplanes;
+    if (frameusage.drawsegs > peakusage.drawsegs)
+	peakusage.drawsegs = frameusage.drawsegs;
+    if (frameusage.vissprites > peakusage.vissprites)
+	peakusage.vissprites = frameusage.vissprites;
+    if (frameusage.openings > peakusage.openings)
+	peakusage.openings = frameusage.openings;
 }
 
 
 
 //
 // R_RenderView
+// Draws the view from whatever level state the view* pointers
+//  are set to.
 //
-void R_RenderPlayerView (player_t* player)
+void R_RenderView (player_t* player)
 {	
     R_SetupFrame (player);
 
@@ -875,21 +952,105 @@ void R_RenderPlayerView (player_t* player)
     // NetUpdate ();
 
     // The head node is the last node output.
+    M_BenchBegin (bench_bsp);
     R_RenderBSPNode (numnodes-1);
+    M_BenchEnd (bench_bsp);
     
     // Check for new console commands.
     // SOKOL CHANGE
     //NetUpdate ();
     
+    M_BenchBegin (bench_planes);
     R_DrawPlanes ();
+    M_BenchEnd (bench_planes);
     
     // Check for new console commands.
     // SOKOL CHANGE
     //NetUpdate ();
     
+    M_BenchBegin (bench_masked);
     R_DrawMasked ();
+    M_BenchEnd (bench_masked);
+
+    // Draw whatever is still queued for the draw threads.
+    if (numdrawthreads > 1)
+	R_FlushDrawQueue ();
+
+    R_RecordUsage ();
 
     // Check for new console commands.
     // SOKOL CHANGE
     //NetUpdate ();				
 }
+
+
+//
+// R_InterpolateSectors
+// Moves the planes part way back to where they were at the
+//  end of the last tic; R_RestoreSectors puts them back.
+//
+static void R_InterpolateSectors (void)
+{
+    sector_t*	sec;
+    fixed_t*	real;
+    int		i;
+
+    if (numsectors * 2 > maxrealheights)
+    {
+	maxrealheights = numsectors * 2;
+	realheights = I_Realloc (realheights,
+				 maxrealheights * sizeof(*realheights));
+    }
+
+    real = realheights;
+
+    for (i=0, sec=sectors ; i<numsectors ; i++, sec++)
+    {
+	*real++ = sec->floorheight;
+	*real++ = sec->ceilingheight;
+
+	sec->floorheight = sec->oldfloorheight
+	    + FixedMul (sec->floorheight - sec->oldfloorheight, fractionaltic);
+	sec->ceilingheight = sec->oldceilingheight
+	    + FixedMul (sec->ceilingheight - sec->oldceilingheight,
+			fractionaltic);
+    }
+}
+
+static void R_RestoreSectors (void)
+{
+    sector_t*	sec;
+    fixed_t*	real;
+    int		i;
+
+    real = realheights;
+
+    for (i=0, sec=sectors ; i<numsectors ; i++, sec++)
+    {
+	sec->floorheight = *real++;
+	sec->ceilingheight = *real++;
+    }
+}
+
+
+//
+// R_RenderPlayerView
+//
+void R_RenderPlayerView (player_t* player)
+{
+    viewsegs = segs;
+    viewsubsectors = subsectors;
+    viewtexturetranslation = texturetranslation;
+    viewflattranslation = flattranslation;
+
+    validcount++;
+    viewvalidcount = validcount;
+
+    if (fractionaltic != FRACUNIT)
+	R_InterpolateSectors ();
+
+    R_RenderView (player);
+
+    if (fractionaltic != FRACUNIT)
+	R_RestoreSectors ();
+}
@@ -45,11 +45,31 @@ extern fixed_t		centeryfrac;
 extern fixed_t		projection;
 
 extern int		validcount;
+extern int		viewvalidcount;
+
+extern fixed_t		fractionaltic;
 
 extern int		linecount;
 extern int		loopcount;
 
 
+//
+// Renderer pool usage.
+// Filled in by R_RenderPlayerView for the last frame;
+//  peakusage keeps the highest counts until cleared.
+//
+typedef struct
+{
+    int		visplanes;
+    int		drawsegs;
+    int		vissprites;
+    int		openings;
+} renderusage_t;
+
+extern renderusage_t	frameusage;
+extern renderusage_t	peakusage;
+
+
 //
 // Lighting LUT.
 // Used for z-depth cuing per column/row,
@@ -151,6 +171,9 @@ R_AddPointToBox
 // Called by G_Drawer.
 void R_RenderPlayerView (player_t *player);
 
+// Draws from the view* level pointers, see r_snap.c.
+void R_RenderView (player_t *player);
+
 // Called by startup code.
 void R_Init (void);
 
@@ -42,16 +42,33 @@ planefunction_t		ceilingfunc;
 //
 
 // Here comes the obnoxious "visplane".
+// Planes are allocated one at a time and kept for later
+//  frames, so floorplane and ceilingplane stay valid when
+//  more are added.  MAXVISPLANES is only the initial count.
 #define MAXVISPLANES	128
-visplane_t		visplanes[MAXVISPLANES];
-visplane_t*		lastvisplane;
+static visplane_t**	visplanes;
+int			numvisplanes;
+static int		maxvisplanes;
 visplane_t*		floorplane;
 visplane_t*		ceilingplane;
 
-// ?
+// R_FindPlane looks planes up by height, picnum and lightlevel.
+//  Heights are whole map units, so the fraction is dropped; the
+//  multiplies fold every key bit into the top bits used as bucket.
+#define VISPLANEHASHBITS	7
+#define VISPLANEHASH		(1 << VISPLANEHASHBITS)
+#define VisplaneHash(height, picnum, lightlevel) \
+    (((unsigned) ((height) >> FRACBITS) * 0x9e3779b1u \
+      ^ (unsigned) (picnum) * 0x85ebca6bu \
+      ^ (unsigned) (lightlevel) * 0xc2b2ae35u) >> (32 - VISPLANEHASHBITS))
+
+static visplane_t*	visplanehash[VISPLANEHASH];
+
+// Initial size, grown by R_CheckOpenings.
 #define MAXOPENINGS	SCREENWIDTH*64
-short			openings[MAXOPENINGS];
+short*			openings;
 short*			lastopening;
+static int		maxopenings;
 
 
 //
@@ -97,6 +114,80 @@ void R_InitPlanes (void)
 }
 
 
+//
+// R_NewVisplane
+// Next unused visplane, allocating more if all are taken.
+//
+static visplane_t *R_NewVisplane (void)
+{
+    int		i;
+
+    if (numvisplanes == maxvisplanes)
+    {
+	maxvisplanes = maxvisplanes ? maxvisplanes * 2 : MAXVISPLANES;
+	visplanes = I_Realloc (visplanes, maxvisplanes * sizeof(*visplanes));
+
+	// R_DrawPlanes reads the pads as empty columns, which
+	//  vanilla got for free from its static array.
+	for (i = numvisplanes; i < maxvisplanes; i++)
+	{
+	    visplanes[i] = I_Realloc (NULL, sizeof(visplane_t));
+	    memset (visplanes[i], 0, sizeof(visplane_t));
+	}
+    }
+
+    return visplanes[numvisplanes++];
+}
+
+
+//
+// R_CheckOpenings
+// Makes room for count more openings.  Drawsegs point into
+//  the openings (offset by their first column), so those
+//  pointers are moved along with the array.
+//
+void R_CheckOpenings (int count)
+{
+    short*	oldopenings;
+    short*	oldlast;
+    drawseg_t*	ds;
+    int		used;
+
+    used = lastopening - openings;
+
+    if (used + count <= maxopenings)
+	return;
+
+    if (maxopenings == 0)
+	maxopenings = MAXOPENINGS;
+
+    while (used + count > maxopenings)
+	maxopenings *= 2;
+
+    oldopenings = openings;
+    oldlast = lastopening;
+
+    openings = I_Realloc (NULL, maxopenings * sizeof(*openings));
+    memcpy (openings, oldopenings, used * sizeof(*openings));
+    lastopening = openings + used;
+
+#define ADJUST(p) \
+    if (ds->p + ds->x1 >= oldopenings && ds->p + ds->x1 <= oldlast) \
+	ds->p = ds->p - oldopenings + openings;
+
+    for (ds = drawsegs; ds < ds_p; ds++)
+    {
+	ADJUST (maskedtexturecol);
+	ADJUST (sprtopclip);
+	ADJUST (sprbottomclip);
+    }
+
+#undef ADJUST
+
+    free (oldopenings);
+}
+
+
 //
 // R_MapPlane
 //
@@ -187,8 +278,9 @@ void R_ClearPlanes (void)
 	ceilingclip[i] = -1;
     }
 
-    lastvisplane = visplanes;
+    numvisplanes = 0;
     lastopening = openings;
+    memset (visplanehash, 0, sizeof(visplanehash));
     
     // texture calculation
     memset (cachedheight, 0, sizeof(cachedheight));
@@ -214,31 +306,29 @@ R_FindPlane
   int		lightlevel )
 {
     visplane_t*	check;
+    unsigned	hash;
 	
     if (picnum == skyflatnum)
     {
 	height = 0;			// all skys map together
 	lightlevel = 0;
     }
+
+    hash = VisplaneHash (height, picnum, lightlevel);
 	
-    for (check=visplanes; check<lastvisplane; check++)
+    for (check=visplanehash[hash]; check; check=check->next)
     {
 	if (height == check->height
 	    && picnum == check->picnum
 	    && lightlevel == check->lightlevel)
 	{
-	    break;
+	    return check;
 	}
     }
     
-			
-    if (check < lastvisplane)
-	return check;
-		
-    if (lastvisplane - visplanes == MAXVISPLANES)
-	I_Error ("R_FindPlane: no more visplanes");
-		
-    lastvisplane++;
+    check = R_NewVisplane ();
+    check->next = visplanehash[hash];
+    visplanehash[hash] = check;
 
     check->height = height;
     check->picnum = picnum;
@@ -266,6 +356,7 @@ R_CheckPlane
     int		unionl;
     int		unionh;
     int		x;
+    visplane_t*	check;
 	
     if (start < pl->minx)
     {
@@ -303,11 +394,15 @@ R_CheckPlane
     }
 	
     // make a new visplane
-    lastvisplane->height = pl->height;
-    lastvisplane->picnum = pl->picnum;
-    lastvisplane->lightlevel = pl->lightlevel;
+    // It is not added to the hash: the plane it was split
+    //  from has the same key and was created first, so a
+    //  linear search never returned the split one either.
+    check = R_NewVisplane ();
+    check->height = pl->height;
+    check->picnum = pl->picnum;
+    check->lightlevel = pl->lightlevel;
     
-    pl = lastvisplane++;
+    pl = check;
     pl->minx = start;
     pl->maxx = stop;
 
@@ -365,23 +460,12 @@ void R_DrawPlanes (void)
     int			stop;
     int			angle;
     int                 lumpnum;
+    int			i;
 				
-#ifdef RANGECHECK
-    if (ds_p - drawsegs > MAXDRAWSEGS)
-	I_Error ("R_DrawPlanes: drawsegs overflow (%i)",
-		 ds_p - drawsegs);
-    
-    if (lastvisplane - visplanes > MAXVISPLANES)
-	I_Error ("R_DrawPlanes: visplane overflow (%i)",
-		 lastvisplane - visplanes);
-    
-    if (lastopening - openings > MAXOPENINGS)
-	I_Error ("R_DrawPlanes: opening overflow (%i)",
-		 lastopening - openings);
-#endif
-
-    for (pl = visplanes ; pl < lastvisplane ; pl++)
+    for (i = 0 ; i < numvisplanes ; i++)
     {
+	pl = visplanes[i];
+
 	if (pl->minx > pl->maxx)
 	    continue;
 
@@ -414,7 +498,7 @@ void R_DrawPlanes (void)
 	}
 	
 	// regular flat
-        lumpnum = firstflat + flattranslation[pl->picnum];
+        lumpnum = firstflat + viewflattranslation[pl->picnum];
 	ds_source = W_CacheLumpNum(lumpnum, PU_STATIC);
 	
 	planeheight = abs(pl->height-viewz);
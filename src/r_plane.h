@@ -26,7 +26,9 @@
 
 
 // Visplane related.
+extern  short*		openings;
 extern  short*		lastopening;
+extern  int		numvisplanes;
 
 
 typedef void (*planefunction_t) (int top, int bottom);
@@ -42,6 +44,7 @@ extern fixed_t		distscale[SCREENWIDTH];
 
 void R_InitPlanes (void);
 void R_ClearPlanes (void);
+void R_CheckOpenings (int count);
 
 void
 R_MapPlane
@@ -0,0 +1,237 @@
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Snapshots of the render-relevant level state.
+//	With -pipeline, the view of tic N is drawn from a snapshot
+//	while P_Ticker runs tic N+1 on another thread.  The renderer
+//	reaches the level only through viewsegs and viewsubsectors
+//	(and from there sectors, sides, lines and things), the texture
+//	and flat translations and the view player, so those are
+//	copied with their pointers rebased onto the copies.
+//	Vertexes, nodes and graphics do not change during a level
+//	and are shared.
+//
+
+#include <string.h>
+
+#include "doomdef.h"
+#include "doomstat.h"
+#include "i_system.h"
+#include "p_local.h"
+#include "r_local.h"
+
+#include "r_snap.h"
+
+extern int		numtextures;
+extern int		numflats;
+
+static boolean		snapvalid;
+
+static sector_t*	snapsectors;
+static side_t*		snapsides;
+static line_t*		snaplines;
+static seg_t*		snapsegs;
+static subsector_t*	snapsubsectors;
+static mobj_t*		snapmobjs;
+static int*		snaptexturetranslation;
+static int*		snapflattranslation;
+
+static int		maxsnapsectors;
+static int		maxsnapsides;
+static int		maxsnaplines;
+static int		maxsnapsegs;
+static int		maxsnapsubsectors;
+static int		maxsnapmobjs;
+
+static player_t		snapplayer;
+static mobj_t		snapplayermo;
+
+// The copies start out unstamped, so this never has
+//  to agree with the playsim's validcount.
+static int		snapvalidcount;
+
+
+//
+// GrowSnapshot
+// Makes room for count entries of size bytes.
+//
+static void
+GrowSnapshot
+( void**	array,
+  int*		max,
+  int		count,
+  size_t	size )
+{
+    if (count <= *max)
+	return;
+
+    *array = I_Realloc (*array, count * size);
+    *max = count;
+}
+
+
+#define REBASE(ptr, from, to)	((ptr) ? (to) + ((ptr) - (from)) : NULL)
+
+
+//
+// R_ClearSnapshot
+//
+void R_ClearSnapshot (void)
+{
+    snapvalid = false;
+}
+
+
+boolean R_SnapshotValid (void)
+{
+    return snapvalid;
+}
+
+
+//
+// R_TakeSnapshot
+//
+void R_TakeSnapshot (player_t* player)
+{
+    int			i;
+    int			count;
+    mobj_t*		thing;
+    mobj_t*		copy;
+    sector_t*		sec;
+
+    // Automap marks made while drawing the last snapshot.
+    if (snapvalid)
+    {
+	for (i=0 ; i<numlines ; i++)
+	{
+	    if (snaplines[i].flags & ML_MAPPED)
+		lines[i].flags |= ML_MAPPED;
+	}
+    }
+
+    snapvalid = false;
+
+    if (!player->mo)
+	return;
+
+    GrowSnapshot ((void **) &snapsectors, &maxsnapsectors,
+		  numsectors, sizeof(*snapsectors));
+    GrowSnapshot ((void **) &snapsides, &maxsnapsides,
+		  numsides, sizeof(*snapsides));
+    GrowSnapshot ((void **) &snaplines, &maxsnaplines,
+		  numlines, sizeof(*snaplines));
+    GrowSnapshot ((void **) &snapsegs, &maxsnapsegs,
+		  numsegs, sizeof(*snapsegs));
+    GrowSnapshot ((void **) &snapsubsectors, &maxsnapsubsectors,
+		  numsubsectors, sizeof(*snapsubsectors));
+
+    if (!snaptexturetranslation)
+    {
+	snaptexturetranslation =
+	    I_Realloc (NULL, (numtextures+1) * sizeof(*snaptexturetranslation));
+	snapflattranslation =
+	    I_Realloc (NULL, (numflats+1) * sizeof(*snapflattranslation));
+    }
+
+    memcpy (snaptexturetranslation, texturetranslation,
+	    (numtextures+1) * sizeof(*snaptexturetranslation));
+    memcpy (snapflattranslation, flattranslation,
+	    (numflats+1) * sizeof(*snapflattranslation));
+
+    // Sectors, with their things.  Only the fields the renderer
+    //  reads are rebased; the rest still point at the level.
+    count = 0;
+
+    for (i=0 ; i<numsectors ; i++)
+    {
+	for (thing = sectors[i].thinglist ; thing ; thing = thing->snext)
+	    count++;
+    }
+
+    GrowSnapshot ((void **) &snapmobjs, &maxsnapmobjs,
+		  count, sizeof(*snapmobjs));
+
+    memcpy (snapsectors, sectors, numsectors * sizeof(*snapsectors));
+
+    copy = snapmobjs;
+
+    for (i=0 ; i<numsectors ; i++)
+    {
+	sec = &snapsectors[i];
+	sec->validcount = 0;
+
+	if (!sec->thinglist)
+	    continue;
+
+	thing = sec->thinglist;
+	sec->thinglist = copy;
+
+	for ( ; thing ; thing = thing->snext)
+	{
+	    *copy = *thing;
+	    copy->subsector = REBASE(thing->subsector,
+				     subsectors, snapsubsectors);
+	    copy->snext = thing->snext ? copy + 1 : NULL;
+	    copy++;
+	}
+    }
+
+    memcpy (snapsides, sides, numsides * sizeof(*snapsides));
+
+    for (i=0 ; i<numsides ; i++)
+	snapsides[i].sector = REBASE(sides[i].sector, sectors, snapsectors);
+
+    memcpy (snaplines, lines, numlines * sizeof(*snaplines));
+
+    for (i=0 ; i<numsegs ; i++)
+    {
+	snapsegs[i] = segs[i];
+	snapsegs[i].sidedef = REBASE(segs[i].sidedef, sides, snapsides);
+	snapsegs[i].linedef = REBASE(segs[i].linedef, lines, snaplines);
+	snapsegs[i].frontsector = REBASE(segs[i].frontsector,
+					 sectors, snapsectors);
+	snapsegs[i].backsector = REBASE(segs[i].backsector,
+					sectors, snapsectors);
+    }
+
+    for (i=0 ; i<numsubsectors ; i++)
+    {
+	snapsubsectors[i] = subsectors[i];
+	snapsubsectors[i].sector = REBASE(subsectors[i].sector,
+					  sectors, snapsectors);
+    }
+
+    // The view player, for R_SetupFrame and the weapon sprites.
+    snapplayer = *player;
+    snapplayermo = *player->mo;
+    snapplayermo.subsector = REBASE(player->mo->subsector,
+				    subsectors, snapsubsectors);
+    snapplayer.mo = &snapplayermo;
+
+    snapvalid = true;
+}
+
+
+//
+// R_RenderSnapshotView
+//
+void R_RenderSnapshotView (void)
+{
+    viewsegs = snapsegs;
+    viewsubsectors = snapsubsectors;
+    viewtexturetranslation = snaptexturetranslation;
+    viewflattranslation = snapflattranslation;
+
+    viewvalidcount = ++snapvalidcount;
+
+    R_RenderView (&snapplayer);
+}
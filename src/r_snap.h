@@ -0,0 +1,34 @@
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Snapshots of the render-relevant level state,
+//	drawn while the playsim runs the next tic.
+//
+
+
+#ifndef __R_SNAP__
+#define __R_SNAP__
+
+#include "d_player.h"
+
+// Called by P_SetupLevel; the old snapshot points into freed data.
+void R_ClearSnapshot (void);
+
+// Copies the level as seen by player after a tic.
+void R_TakeSnapshot (player_t* player);
+
+boolean R_SnapshotValid (void);
+
+// Draws the last snapshot.  Touches nothing the playsim owns.
+void R_RenderSnapshotView (void);
+
+#endif
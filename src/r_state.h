@@ -101,6 +101,12 @@ extern fixed_t		viewz;
 extern angle_t		viewangle;
 extern player_t*	viewplayer;
 
+// Level state being drawn, see R_RenderPlayerView.
+extern seg_t*		viewsegs;
+extern subsector_t*	viewsubsectors;
+extern int*		viewtexturetranslation;
+extern int*		viewflattranslation;
+
 
 // ?
 extern angle_t		clipangle;
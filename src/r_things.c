@@ -28,6 +28,7 @@
 
 #include "i_swap.h"
 #include "i_system.h"
+#include "i_timer.h"
 #include "z_zone.h"
 #include "w_wad.h"
 
@@ -278,9 +279,9 @@ void R_InitSpriteDefs (char** namelist)
 //
 // GAME FUNCTIONS
 //
-vissprite_t	vissprites[MAXVISSPRITES];
+vissprite_t*	vissprites;
 vissprite_t*	vissprite_p;
-int		newvissprite;
+static int	maxvissprites;
 
 
 
@@ -314,14 +315,24 @@ void R_ClearSprites (void)
 
 //
 // R_NewVisSprite
+// The array grows rather than dropping sprites.  Vissprites
+//  are only linked together when sorted, after all of them
+//  have been added.
 //
-vissprite_t	overflowsprite;
-
 vissprite_t* R_NewVisSprite (void)
 {
-    if (vissprite_p == &vissprites[MAXVISSPRITES])
-	return &overflowsprite;
-    
+    int		used;
+
+    used = vissprite_p - vissprites;
+
+    if (used == maxvissprites)
+    {
+	maxvissprites = maxvissprites ? maxvissprites * 2 : MAXVISSPRITES;
+	vissprites = I_Realloc (vissprites,
+				maxvissprites * sizeof(*vissprites));
+	vissprite_p = vissprites + used;
+    }
+
     vissprite_p++;
     return vissprite_p-1;
 }
@@ -443,6 +454,10 @@ R_DrawVisSprite
 //
 void R_ProjectSprite (mobj_t* thing)
 {
+    fixed_t		x;
+    fixed_t		y;
+    fixed_t		z;
+
     fixed_t		tr_x;
     fixed_t		tr_y;
     
@@ -471,9 +486,23 @@ void R_ProjectSprite (mobj_t* thing)
     angle_t		ang;
     fixed_t		iscale;
     
+    // between tics with -uncapped
+    if (fractionaltic != FRACUNIT && thing->interp)
+    {
+	x = thing->oldx + FixedMul (thing->x - thing->oldx, fractionaltic);
+	y = thing->oldy + FixedMul (thing->y - thing->oldy, fractionaltic);
+	z = thing->oldz + FixedMul (thing->z - thing->oldz, fractionaltic);
+    }
+    else
+    {
+	x = thing->x;
+	y = thing->y;
+	z = thing->z;
+    }
+
     // transform the origin point
-    tr_x = thing->x - viewx;
-    tr_y = thing->y - viewy;
+    tr_x = x - viewx;
+    tr_y = y - viewy;
 	
     gxt = FixedMul(tr_x,viewcos); 
     gyt = -FixedMul(tr_y,viewsin);
@@ -511,7 +540,7 @@ void R_ProjectSprite (mobj_t* thing)
     if (sprframe->rotate)
     {
 	// choose a different rotation based on player view
-	ang = R_PointToAngle (thing->x, thing->y);
+	ang = R_PointToAngle (x, y);
 	rot = (ang-thing->angle+(unsigned)(ANG45/2)*9)>>29;
 	lump = sprframe->lump[rot];
 	flip = (boolean)sprframe->flip[rot];
@@ -542,10 +571,10 @@ void R_ProjectSprite (mobj_t* thing)
     vis = R_NewVisSprite ();
     vis->mobjflags = thing->flags;
     vis->scale = xscale<<detailshift;
-    vis->gx = thing->x;
-    vis->gy = thing->y;
-    vis->gz = thing->z;
-    vis->gzt = thing->z + spritetopoffset[lump];
+    vis->gx = x;
+    vis->gy = y;
+    vis->gz = z;
+    vis->gzt = z + spritetopoffset[lump];
     vis->texturemid = vis->gzt - viewz;
     vis->x1 = x1 < 0 ? 0 : x1;
     vis->x2 = x2 >= viewwidth ? viewwidth-1 : x2;	
@@ -611,11 +640,11 @@ void R_AddSprites (sector_t* sec)
     // A sector might have been split into several
     //  subsectors during BSP building.
     // Thus we check whether its already added.
-    if (sec->validcount == validcount)
+    if (sec->validcount == viewvalidcount)
 	return;		
 
     // Well, now it will be done.
-    sec->validcount = validcount;
+    sec->validcount = viewvalidcount;
 	
     lightnum = (sec->lightlevel >> LIGHTSEGSHIFT)+extralight;
 
@@ -772,11 +801,156 @@ void R_DrawPlayerSprites (void)
 
 //
 // R_SortVisSprites
+// Links the vissprites from vsprsortedhead in order of increasing
+//  scale.  Sprites of equal scale keep the order they were added
+//  in, as with the selection sort this replaces.
 //
 vissprite_t	vsprsortedhead;
 
+typedef struct
+{
+    unsigned int	scale;
+    int			index;
+} vissortkey_t;
+
+// Below this many sprites an insertion sort beats the radix
+//  sort; see -benchsort.
+#define VISSORTCUTOFF	64
+
+static vissortkey_t*	sortkeys;
+static vissortkey_t*	sorttemp;
+static int		maxsortkeys;
+
+
+static void InsertionSortKeys (vissortkey_t* keys, int count)
+{
+    int			i;
+    int			j;
+    vissortkey_t	key;
+
+    for (i=1 ; i<count ; i++)
+    {
+	key = keys[i];
+
+	for (j=i ; j>0 && keys[j-1].scale > key.scale ; j--)
+	    keys[j] = keys[j-1];
+
+	keys[j] = key;
+    }
+}
+
+
+//
+// RadixSortKeys
+// Stable LSD radix sort, a byte at a time.  Bytes that are the
+//  same in every key, usually the top one, are skipped.
+//  Returns the array holding the result.
+//
+static vissortkey_t*
+RadixSortKeys
+( vissortkey_t*	keys,
+  vissortkey_t*	temp,
+  int		count )
+{
+    int			counts[4][256];
+    int			pass;
+    int			shift;
+    int			i;
+    int			sum;
+    int			n;
+    int*		c;
+    vissortkey_t*	swap;
+
+    memset (counts, 0, sizeof(counts));
+
+    for (i=0 ; i<count ; i++)
+    {
+	counts[0][keys[i].scale & 0xff]++;
+	counts[1][(keys[i].scale >> 8) & 0xff]++;
+	counts[2][(keys[i].scale >> 16) & 0xff]++;
+	counts[3][keys[i].scale >> 24]++;
+    }
+
+    for (pass=0, shift=0 ; pass<4 ; pass++, shift += 8)
+    {
+	c = counts[pass];
+
+	if (c[(keys[0].scale >> shift) & 0xff] == count)
+	    continue;
+
+	for (i=0, sum=0 ; i<256 ; i++)
+	{
+	    n = c[i];
+	    c[i] = sum;
+	    sum += n;
+	}
+
+	for (i=0 ; i<count ; i++)
+	    temp[c[(keys[i].scale >> shift) & 0xff]++] = keys[i];
+
+	swap = keys;
+	keys = temp;
+	temp = swap;
+    }
+
+    return keys;
+}
+
 
 void R_SortVisSprites (void)
+{
+    int			i;
+    int			count;
+    vissortkey_t*	keys;
+    vissprite_t*	ds;
+
+    count = vissprite_p - vissprites;
+
+    vsprsortedhead.next = vsprsortedhead.prev = &vsprsortedhead;
+
+    if (!count)
+	return;
+
+    if (count > maxsortkeys)
+    {
+	maxsortkeys = maxvissprites;
+	sortkeys = I_Realloc (sortkeys, maxsortkeys * sizeof(*sortkeys));
+	sorttemp = I_Realloc (sorttemp, maxsortkeys * sizeof(*sorttemp));
+    }
+
+    // scale is positive, so it orders the same unsigned
+    for (i=0 ; i<count ; i++)
+    {
+	sortkeys[i].scale = vissprites[i].scale;
+	sortkeys[i].index = i;
+    }
+
+    if (count < VISSORTCUTOFF)
+    {
+	keys = sortkeys;
+	InsertionSortKeys (keys, count);
+    }
+    else
+    {
+	keys = RadixSortKeys (sortkeys, sorttemp, count);
+    }
+
+    for (i=0 ; i<count ; i++)
+    {
+	ds = &vissprites[keys[i].index];
+	ds->prev = vsprsortedhead.prev;
+	ds->next = &vsprsortedhead;
+	vsprsortedhead.prev->next = ds;
+	vsprsortedhead.prev = ds;
+    }
+}
+
+
+//
+// SelectionSortVisSprites
+// The original O(n^2) sort, kept as the reference for -benchsort.
+//
+static void SelectionSortVisSprites (void)
 {
     int			i;
     int			count;
@@ -828,6 +1002,110 @@ void R_SortVisSprites (void)
 }
 
 
+//
+// R_BenchSortVisSprites
+// Times the selection sort, the insertion sort and the radix
+//  sort on random scales for a range of sprite counts, checks
+//  that they give the same order and prints a table.  Needs
+//  nothing set up.
+//
+void R_BenchSortVisSprites (void)
+{
+    static const int	counts[] =
+    {
+	4, 8, 16, 24, 32, 48, 64, 96, 128, 256, 512, 1024
+    };
+    vissprite_t*	order[1024];
+    vissprite_t*	spr;
+    vissortkey_t*	keys;
+    uint64_t		start;
+    uint64_t		us[3];
+    int			c;
+    int			count;
+    int			rep;
+    int			reps;
+    int			i;
+    int			n;
+
+    printf ("%8s %12s %12s %12s   (ns per sort)\n",
+	    "sprites", "selection", "insertion", "radix");
+
+    for (c=0 ; c<arrlen(counts) ; c++)
+    {
+	count = counts[c];
+	reps = 2000000 / (count * 8);
+
+	R_ClearSprites ();
+
+	// Scales in the range R_ProjectSprite produces, with
+	//  a few sprites at exactly the same distance.
+	for (i=0 ; i<count ; i++)
+	{
+	    spr = R_NewVisSprite ();
+	    spr->scale = (rand () % 64) * FRACUNIT + (rand () % 16) * 0x1000 + 0x800;
+	}
+
+	if (count > maxsortkeys)
+	{
+	    maxsortkeys = maxvissprites;
+	    sortkeys = I_Realloc (sortkeys, maxsortkeys * sizeof(*sortkeys));
+	    sorttemp = I_Realloc (sorttemp, maxsortkeys * sizeof(*sorttemp));
+	}
+
+	start = I_GetTimeUS ();
+	for (rep=0 ; rep<reps ; rep++)
+	    SelectionSortVisSprites ();
+	us[0] = I_GetTimeUS () - start;
+
+	for (spr=vsprsortedhead.next, n=0 ; spr!=&vsprsortedhead ; spr=spr->next)
+	    order[n++] = spr;
+
+	start = I_GetTimeUS ();
+	for (rep=0 ; rep<reps ; rep++)
+	{
+	    for (i=0 ; i<count ; i++)
+	    {
+		sortkeys[i].scale = vissprites[i].scale;
+		sortkeys[i].index = i;
+	    }
+	    InsertionSortKeys (sortkeys, count);
+	}
+	us[1] = I_GetTimeUS () - start;
+
+	for (i=0 ; i<count ; i++)
+	{
+	    if (&vissprites[sortkeys[i].index] != order[i])
+		I_Error ("R_BenchSortVisSprites: insertion sort differs "
+			 "for %i sprites", count);
+	}
+
+	keys = sortkeys;
+	start = I_GetTimeUS ();
+	for (rep=0 ; rep<reps ; rep++)
+	{
+	    for (i=0 ; i<count ; i++)
+	    {
+		sortkeys[i].scale = vissprites[i].scale;
+		sortkeys[i].index = i;
+	    }
+	    keys = RadixSortKeys (sortkeys, sorttemp, count);
+	}
+	us[2] = I_GetTimeUS () - start;
+
+	for (i=0 ; i<count ; i++)
+	{
+	    if (&vissprites[keys[i].index] != order[i])
+		I_Error ("R_BenchSortVisSprites: radix sort differs "
+			 "for %i sprites", count);
+	}
+
+	printf ("%8i %12.1f %12.1f %12.1f\n", count,
+		us[0] * 1000.0 / reps, us[1] * 1000.0 / reps,
+		us[2] * 1000.0 / reps);
+    }
+}
+
+
 
 //
 // R_DrawSprite
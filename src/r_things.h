@@ -22,9 +22,10 @@
 
 
 
+// Initial size of the vissprite array, which grows as needed.
 #define MAXVISSPRITES  	128
 
-extern vissprite_t	vissprites[MAXVISSPRITES];
+extern vissprite_t*	vissprites;
 extern vissprite_t*	vissprite_p;
 extern vissprite_t	vsprsortedhead;
 
@@ -48,6 +49,9 @@ void R_DrawMaskedColumn (column_t* column);
 
 void R_SortVisSprites (void);
 
+// Prints sort timings for -benchsort.
+void R_BenchSortVisSprites (void);
+
 void R_AddSprites (sector_t* sec);
 void R_AddPSprites (void);
 void R_DrawSprites (void);
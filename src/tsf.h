@@ -147,6 +147,11 @@ TSFDEF void tsf_set_volume(tsf* f, float global_gain);
 //   max_voices: maximum number to pre-allocate and set the limit to
 TSFDEF void tsf_set_max_voices(tsf* f, int max_voices);
 
+// When all voices set with tsf_set_max_voices are playing, let a new note take
+// over the quietest released voice, or if none is released the oldest one
+//   flag_steal: 0 to not play the new note (default), otherwise steal a voice
+TSFDEF void tsf_set_voice_stealing(tsf* f, int flag_steal);
+
 // Start playing a note
 //   preset_index: preset index >= 0 and < tsf_get_presetcount()
 //   key: note value between 0 and 127 (60 being middle C)
@@ -177,6 +182,11 @@ TSFDEF int tsf_active_voice_count(tsf* f);
 TSFDEF void tsf_render_short(tsf* f, short* buffer, int samples, int flag_mixing CPP_DEFAULT0);
 TSFDEF void tsf_render_float(tsf* f, float* buffer, int samples, int flag_mixing CPP_DEFAULT0);
 
+// Render only the voices first, first + step, first + 2 * step, ... mixing into buffer
+// Voices do not share state while rendering, so disjoint groups can be rendered
+// on separate threads into separate buffers, as long as no other call runs meanwhile
+TSFDEF void tsf_render_float_voices(tsf* f, float* buffer, int samples, int first, int step);
+
 // Higher level channel based functions, set up channel parameters
 //   channel: channel number
 //   preset_index: preset index >= 0 and < tsf_get_presetcount()
@@ -240,6 +250,12 @@ TSFDEF float tsf_channel_get_tuning(tsf* f, int channel);
 #define TSF_RENDER_EFFECTSAMPLEBLOCK 64
 #endif
 
+// SSE2 is always available on x86-64, define TSF_NO_SIMD to use plain C.
+#if !defined(TSF_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#  define TSF_SSE2
+#  include <emmintrin.h>
+#endif
+
 // Grace release time for quick voice off (avoid clicking noise)
 #define TSF_FASTRELEASETIME 0.01f
 
@@ -307,6 +323,7 @@ struct tsf
 	int presetNum;
 	int voiceNum;
 	int maxVoiceNum;
+	int voiceStealing;
 	int outputSampleSize;
 	unsigned int voicePlayIndex;
 
@@ -1051,145 +1068,249 @@ static void tsf_voice_calcpitchratio(struct tsf_voice* v, float pitchShift, floa
 	v->pitchOutputFactor = v->region->sample_rate / (tsf_timecents2Secsd(v->region->pitch_keycenter * 100.0) * outSampleRate);
 }
 
-static void tsf_voice_render(tsf* f, struct tsf_voice* v, float* outputBuffer, int numSamples)
+// Per-call state of a rendering voice, cached out of the region and the voice.
+struct tsf_voice_renderstate
 {
-	struct tsf_region* region = v->region;
-	float* input = f->fontSamples;
-	float* outL = outputBuffer;
-	float* outR = (f->outputmode == TSF_STEREO_UNWEAVED ? outL + numSamples : TSF_NULL);
+	struct tsf_voice* v;
+	TSF_BOOL updateModEnv, updateModLFO, updateVibLFO, isLooping;
+	TSF_BOOL dynamicLowpass, dynamicPitchRatio, dynamicGain;
+	unsigned int loopStart, loopEnd;
+	double sampleEndDbl, loopEndDbl, sourceSamplePosition, pitchRatio;
+	struct tsf_voice_lowpass lowpass;
+	float initialFilterFc, modLfoToFilterFc, modEnvToFilterFc;
+	float modLfoToPitch, vibLfoToPitch, modEnvToPitch;
+	float noteGain, modLfoToVolume, gainMono;
+};
 
-	// Cache some values, to give them at least some chance of ending up in registers.
-	TSF_BOOL updateModEnv = (region->modEnvToPitch || region->modEnvToFilterFc);
-	TSF_BOOL updateModLFO = (v->modlfo.delta && (region->modLfoToPitch || region->modLfoToFilterFc || region->modLfoToVolume));
-	TSF_BOOL updateVibLFO = (v->viblfo.delta && (region->vibLfoToPitch));
-	TSF_BOOL isLooping    = (v->loopStart < v->loopEnd);
-	unsigned int tmpLoopStart = v->loopStart, tmpLoopEnd = v->loopEnd;
-	double tmpSampleEndDbl = (double)region->end, tmpLoopEndDbl = (double)tmpLoopEnd + 1.0;
-	double tmpSourceSamplePosition = v->sourceSamplePosition;
-	struct tsf_voice_lowpass tmpLowpass = v->lowpass;
+static void tsf_voice_render_begin(struct tsf_voice_renderstate* s, struct tsf_voice* v)
+{
+	struct tsf_region* region = v->region;
+	s->v = v;
+	s->updateModEnv = (region->modEnvToPitch || region->modEnvToFilterFc);
+	s->updateModLFO = (v->modlfo.delta && (region->modLfoToPitch || region->modLfoToFilterFc || region->modLfoToVolume));
+	s->updateVibLFO = (v->viblfo.delta && (region->vibLfoToPitch));
+	s->isLooping    = (v->loopStart < v->loopEnd);
+	s->loopStart = v->loopStart, s->loopEnd = v->loopEnd;
+	s->sampleEndDbl = (double)region->end, s->loopEndDbl = (double)s->loopEnd + 1.0;
+	s->sourceSamplePosition = v->sourceSamplePosition;
+	s->lowpass = v->lowpass;
 
-	TSF_BOOL dynamicLowpass = (region->modLfoToFilterFc || region->modEnvToFilterFc);
-	float tmpSampleRate = f->outSampleRate, tmpInitialFilterFc, tmpModLfoToFilterFc, tmpModEnvToFilterFc;
+	s->dynamicLowpass = (region->modLfoToFilterFc || region->modEnvToFilterFc);
+	s->dynamicPitchRatio = (region->modLfoToPitch || region->modEnvToPitch || region->vibLfoToPitch);
+	s->dynamicGain = (region->modLfoToVolume != 0);
+	s->noteGain = 0;
 
-	TSF_BOOL dynamicPitchRatio = (region->modLfoToPitch || region->modEnvToPitch || region->vibLfoToPitch);
-	double pitchRatio;
-	float tmpModLfoToPitch, tmpVibLfoToPitch, tmpModEnvToPitch;
+	if (s->dynamicLowpass) s->initialFilterFc = (float)region->initialFilterFc, s->modLfoToFilterFc = (float)region->modLfoToFilterFc, s->modEnvToFilterFc = (float)region->modEnvToFilterFc;
+	else s->initialFilterFc = 0, s->modLfoToFilterFc = 0, s->modEnvToFilterFc = 0;
 
-	TSF_BOOL dynamicGain = (region->modLfoToVolume != 0);
-	float noteGain = 0, tmpModLfoToVolume;
+	if (s->dynamicPitchRatio) s->pitchRatio = 0, s->modLfoToPitch = (float)region->modLfoToPitch, s->vibLfoToPitch = (float)region->vibLfoToPitch, s->modEnvToPitch = (float)region->modEnvToPitch;
+	else s->pitchRatio = tsf_timecents2Secsd(v->pitchInputTimecents) * v->pitchOutputFactor, s->modLfoToPitch = 0, s->vibLfoToPitch = 0, s->modEnvToPitch = 0;
 
-	if (dynamicLowpass) tmpInitialFilterFc = (float)region->initialFilterFc, tmpModLfoToFilterFc = (float)region->modLfoToFilterFc, tmpModEnvToFilterFc = (float)region->modEnvToFilterFc;
-	else tmpInitialFilterFc = 0, tmpModLfoToFilterFc = 0, tmpModEnvToFilterFc = 0;
+	if (s->dynamicGain) s->modLfoToVolume = (float)region->modLfoToVolume * 0.1f;
+	else s->noteGain = tsf_decibelsToGain(v->noteGainDB), s->modLfoToVolume = 0;
+}
 
-	if (dynamicPitchRatio) pitchRatio = 0, tmpModLfoToPitch = (float)region->modLfoToPitch, tmpVibLfoToPitch = (float)region->vibLfoToPitch, tmpModEnvToPitch = (float)region->modEnvToPitch;
-	else pitchRatio = tsf_timecents2Secsd(v->pitchInputTimecents) * v->pitchOutputFactor, tmpModLfoToPitch = 0, tmpVibLfoToPitch = 0, tmpModEnvToPitch = 0;
+// Updates the effects for one block and writes its unfiltered samples to vals.
+// Returns the number of samples, less than blockSamples if the sample ended.
+static int tsf_voice_render_block(tsf* f, struct tsf_voice_renderstate* s, int blockSamples, float* vals)
+{
+	struct tsf_voice* v = s->v;
+	float* input = f->fontSamples;
+	float tmpSampleRate = f->outSampleRate;
 
-	if (dynamicGain) tmpModLfoToVolume = (float)region->modLfoToVolume * 0.1f;
-	else noteGain = tsf_decibelsToGain(v->noteGainDB), tmpModLfoToVolume = 0;
+	// Cache some values, to give them at least some chance of ending up in registers.
+	TSF_BOOL isLooping = s->isLooping;
+	unsigned int tmpLoopStart = s->loopStart, tmpLoopEnd = s->loopEnd;
+	double tmpSampleEndDbl = s->sampleEndDbl, tmpLoopEndDbl = s->loopEndDbl;
+	double tmpSourceSamplePosition = s->sourceSamplePosition, pitchRatio;
+	float* val = vals;
 
-	while (numSamples)
+	if (s->dynamicLowpass)
 	{
-		float gainMono, gainLeft, gainRight;
-		int blockSamples = (numSamples > TSF_RENDER_EFFECTSAMPLEBLOCK ? TSF_RENDER_EFFECTSAMPLEBLOCK : numSamples);
-		numSamples -= blockSamples;
+		float fres = s->initialFilterFc + v->modlfo.level * s->modLfoToFilterFc + v->modenv.level * s->modEnvToFilterFc;
+		float lowpassFc = (fres <= 13500 ? tsf_cents2Hertz(fres) / tmpSampleRate : 1.0f);
+		s->lowpass.active = (lowpassFc < 0.499f);
+		if (s->lowpass.active) tsf_voice_lowpass_setup(&s->lowpass, lowpassFc);
+	}
 
-		if (dynamicLowpass)
-		{
-			float fres = tmpInitialFilterFc + v->modlfo.level * tmpModLfoToFilterFc + v->modenv.level * tmpModEnvToFilterFc;
-			float lowpassFc = (fres <= 13500 ? tsf_cents2Hertz(fres) / tmpSampleRate : 1.0f);
-			tmpLowpass.active = (lowpassFc < 0.499f);
-			if (tmpLowpass.active) tsf_voice_lowpass_setup(&tmpLowpass, lowpassFc);
-		}
+	if (s->dynamicPitchRatio)
+		s->pitchRatio = tsf_timecents2Secsd(v->pitchInputTimecents + (v->modlfo.level * s->modLfoToPitch + v->viblfo.level * s->vibLfoToPitch + v->modenv.level * s->modEnvToPitch)) * v->pitchOutputFactor;
+	pitchRatio = s->pitchRatio;
 
-		if (dynamicPitchRatio)
-			pitchRatio = tsf_timecents2Secsd(v->pitchInputTimecents + (v->modlfo.level * tmpModLfoToPitch + v->viblfo.level * tmpVibLfoToPitch + v->modenv.level * tmpModEnvToPitch)) * v->pitchOutputFactor;
+	if (s->dynamicGain)
+		s->noteGain = tsf_decibelsToGain(v->noteGainDB + (v->modlfo.level * s->modLfoToVolume));
 
-		if (dynamicGain)
-			noteGain = tsf_decibelsToGain(v->noteGainDB + (v->modlfo.level * tmpModLfoToVolume));
+	s->gainMono = s->noteGain * v->ampenv.level;
 
-		gainMono = noteGain * v->ampenv.level;
+	// Update EG.
+	tsf_voice_envelope_process(&v->ampenv, blockSamples, tmpSampleRate);
+	if (s->updateModEnv) tsf_voice_envelope_process(&v->modenv, blockSamples, tmpSampleRate);
 
-		// Update EG.
-		tsf_voice_envelope_process(&v->ampenv, blockSamples, tmpSampleRate);
-		if (updateModEnv) tsf_voice_envelope_process(&v->modenv, blockSamples, tmpSampleRate);
+	// Update LFOs.
+	if (s->updateModLFO) tsf_voice_lfo_process(&v->modlfo, blockSamples);
+	if (s->updateVibLFO) tsf_voice_lfo_process(&v->viblfo, blockSamples);
 
-		// Update LFOs.
-		if (updateModLFO) tsf_voice_lfo_process(&v->modlfo, blockSamples);
-		if (updateVibLFO) tsf_voice_lfo_process(&v->viblfo, blockSamples);
+	while (blockSamples-- && tmpSourceSamplePosition < tmpSampleEndDbl)
+	{
+		unsigned int pos = (unsigned int)tmpSourceSamplePosition, nextPos = (pos >= tmpLoopEnd && isLooping ? tmpLoopStart : pos + 1);
 
-		switch (f->outputmode)
-		{
-			case TSF_STEREO_INTERLEAVED:
-				gainLeft = gainMono * v->panFactorLeft, gainRight = gainMono * v->panFactorRight;
-				while (blockSamples-- && tmpSourceSamplePosition < tmpSampleEndDbl)
-				{
-					unsigned int pos = (unsigned int)tmpSourceSamplePosition, nextPos = (pos >= tmpLoopEnd && isLooping ? tmpLoopStart : pos + 1);
+		// Simple linear interpolation.
+		float alpha = (float)(tmpSourceSamplePosition - pos);
+		*val++ = (input[pos] * (1.0f - alpha) + input[nextPos] * alpha);
 
-					// Simple linear interpolation.
-					float alpha = (float)(tmpSourceSamplePosition - pos), val = (input[pos] * (1.0f - alpha) + input[nextPos] * alpha);
+		// Next sample.
+		tmpSourceSamplePosition += pitchRatio;
+		if (tmpSourceSamplePosition >= tmpLoopEndDbl && isLooping) tmpSourceSamplePosition -= (tmpLoopEnd - tmpLoopStart + 1.0);
+	}
 
-					// Low-pass filter.
-					if (tmpLowpass.active) val = tsf_voice_lowpass_process(&tmpLowpass, val);
+	s->sourceSamplePosition = tmpSourceSamplePosition;
+	return (int)(val - vals);
+}
 
-					*outL++ += val * gainLeft;
-					*outL++ += val * gainRight;
+static void tsf_voice_render_lowpass(struct tsf_voice_renderstate* s, float* vals, int numSamples)
+{
+	struct tsf_voice_lowpass tmpLowpass = s->lowpass;
+	if (!tmpLowpass.active) return;
+	for (; numSamples; numSamples--, vals++) *vals = tsf_voice_lowpass_process(&tmpLowpass, *vals);
+	s->lowpass = tmpLowpass;
+}
 
-					// Next sample.
-					tmpSourceSamplePosition += pitchRatio;
-					if (tmpSourceSamplePosition >= tmpLoopEndDbl && isLooping) tmpSourceSamplePosition -= (tmpLoopEnd - tmpLoopStart + 1.0);
-				}
-				break;
+#ifdef TSF_SSE2
+// The filter is a recurrence, so a single voice cannot be vectorized.
+// Two voices run side by side in the double lanes instead, with the same
+// operations in the same order as tsf_voice_lowpass_process.
+static void tsf_voice_render_lowpass2(struct tsf_voice_renderstate* a, struct tsf_voice_renderstate* b, float* valsA, float* valsB, int numSamples)
+{
+	__m128d a0 = _mm_set_pd(b->lowpass.a0, a->lowpass.a0), a1 = _mm_set_pd(b->lowpass.a1, a->lowpass.a1);
+	__m128d b1 = _mm_set_pd(b->lowpass.b1, a->lowpass.b1), b2 = _mm_set_pd(b->lowpass.b2, a->lowpass.b2);
+	__m128d z1 = _mm_set_pd(b->lowpass.z1, a->lowpass.z1), z2 = _mm_set_pd(b->lowpass.z2, a->lowpass.z2);
+	double z[2];
+	int i;
+	for (i = 0; i < numSamples; i++)
+	{
+		__m128d In = _mm_set_pd(valsB[i], valsA[i]);
+		__m128d Out = _mm_add_pd(_mm_mul_pd(In, a0), z1);
+		__m128 res = _mm_cvtpd_ps(Out);
+		z1 = _mm_sub_pd(_mm_add_pd(_mm_mul_pd(In, a1), z2), _mm_mul_pd(b1, Out));
+		z2 = _mm_sub_pd(_mm_mul_pd(In, a0), _mm_mul_pd(b2, Out));
+		_mm_store_ss(&valsA[i], res);
+		_mm_store_ss(&valsB[i], _mm_shuffle_ps(res, res, _MM_SHUFFLE(1, 1, 1, 1)));
+	}
+	_mm_storeu_pd(z, z1); a->lowpass.z1 = z[0], b->lowpass.z1 = z[1];
+	_mm_storeu_pd(z, z2); a->lowpass.z2 = z[0], b->lowpass.z2 = z[1];
+}
+#endif
 
-			case TSF_STEREO_UNWEAVED:
-				gainLeft = gainMono * v->panFactorLeft, gainRight = gainMono * v->panFactorRight;
-				while (blockSamples-- && tmpSourceSamplePosition < tmpSampleEndDbl)
+static void tsf_voice_render_mix(tsf* f, struct tsf_voice_renderstate* s, const float* vals, int numSamples, float* outputBuffer, int offset, int totalSamples)
+{
+	float gainMono = s->gainMono, gainLeft, gainRight;
+	int i = 0;
+	switch (f->outputmode)
+	{
+		case TSF_STEREO_INTERLEAVED:
+		{
+			float* out = outputBuffer + offset * 2;
+			gainLeft = gainMono * s->v->panFactorLeft, gainRight = gainMono * s->v->panFactorRight;
+#ifdef TSF_SSE2
+			{
+				__m128 gains = _mm_setr_ps(gainLeft, gainRight, gainLeft, gainRight);
+				for (; i + 4 <= numSamples; i += 4)
 				{
-					unsigned int pos = (unsigned int)tmpSourceSamplePosition, nextPos = (pos >= tmpLoopEnd && isLooping ? tmpLoopStart : pos + 1);
-
-					// Simple linear interpolation.
-					float alpha = (float)(tmpSourceSamplePosition - pos), val = (input[pos] * (1.0f - alpha) + input[nextPos] * alpha);
-
-					// Low-pass filter.
-					if (tmpLowpass.active) val = tsf_voice_lowpass_process(&tmpLowpass, val);
+					__m128 val = _mm_loadu_ps(vals + i);
+					_mm_storeu_ps(out + i * 2, _mm_add_ps(_mm_loadu_ps(out + i * 2), _mm_mul_ps(_mm_unpacklo_ps(val, val), gains)));
+					_mm_storeu_ps(out + i * 2 + 4, _mm_add_ps(_mm_loadu_ps(out + i * 2 + 4), _mm_mul_ps(_mm_unpackhi_ps(val, val), gains)));
+				}
+			}
+#endif
+			for (; i < numSamples; i++)
+			{
+				out[i * 2] += vals[i] * gainLeft;
+				out[i * 2 + 1] += vals[i] * gainRight;
+			}
+			break;
+		}
 
-					*outL++ += val * gainLeft;
-					*outR++ += val * gainRight;
+		case TSF_STEREO_UNWEAVED:
+		{
+			float* outL = outputBuffer + offset;
+			float* outR = outL + totalSamples;
+			gainLeft = gainMono * s->v->panFactorLeft, gainRight = gainMono * s->v->panFactorRight;
+			for (; i < numSamples; i++)
+			{
+				outL[i] += vals[i] * gainLeft;
+				outR[i] += vals[i] * gainRight;
+			}
+			break;
+		}
 
-					// Next sample.
-					tmpSourceSamplePosition += pitchRatio;
-					if (tmpSourceSamplePosition >= tmpLoopEndDbl && isLooping) tmpSourceSamplePosition -= (tmpLoopEnd - tmpLoopStart + 1.0);
-				}
-				break;
+		case TSF_MONO:
+		{
+			float* out = outputBuffer + offset;
+			for (; i < numSamples; i++)
+				out[i] += vals[i] * gainMono;
+			break;
+		}
+	}
+}
 
-			case TSF_MONO:
-				while (blockSamples-- && tmpSourceSamplePosition < tmpSampleEndDbl)
-				{
-					unsigned int pos = (unsigned int)tmpSourceSamplePosition, nextPos = (pos >= tmpLoopEnd && isLooping ? tmpLoopStart : pos + 1);
+// Renders one or two voices (b may be null) block by block.
+// Voices are mixed in order within each block, so the output does not
+// depend on whether a voice was rendered on its own or paired.
+static void tsf_voice_render_pair(tsf* f, struct tsf_voice* va, struct tsf_voice* vb, float* outputBuffer, int numSamples)
+{
+	struct tsf_voice_renderstate a, b;
+	float valsA[TSF_RENDER_EFFECTSAMPLEBLOCK], valsB[TSF_RENDER_EFFECTSAMPLEBLOCK];
+	TSF_BOOL liveA = TSF_TRUE, liveB = (vb != TSF_NULL);
+	int offset = 0;
 
-					// Simple linear interpolation.
-					float alpha = (float)(tmpSourceSamplePosition - pos), val = (input[pos] * (1.0f - alpha) + input[nextPos] * alpha);
+	tsf_voice_render_begin(&a, va);
+	if (liveB) tsf_voice_render_begin(&b, vb);
 
-					// Low-pass filter.
-					if (tmpLowpass.active) val = tsf_voice_lowpass_process(&tmpLowpass, val);
+	while (offset < numSamples && (liveA || liveB))
+	{
+		int blockSamples = (numSamples - offset > TSF_RENDER_EFFECTSAMPLEBLOCK ? TSF_RENDER_EFFECTSAMPLEBLOCK : numSamples - offset);
+		int countA = 0, countB = 0, paired = 0;
 
-					*outL++ += val * gainMono;
+		if (liveA) countA = tsf_voice_render_block(f, &a, blockSamples, valsA);
+		if (liveB) countB = tsf_voice_render_block(f, &b, blockSamples, valsB);
 
-					// Next sample.
-					tmpSourceSamplePosition += pitchRatio;
-					if (tmpSourceSamplePosition >= tmpLoopEndDbl && isLooping) tmpSourceSamplePosition -= (tmpLoopEnd - tmpLoopStart + 1.0);
-				}
-				break;
+		// Low-pass filter.
+#ifdef TSF_SSE2
+		if (liveA && liveB && a.lowpass.active && b.lowpass.active)
+		{
+			paired = (countA < countB ? countA : countB);
+			tsf_voice_render_lowpass2(&a, &b, valsA, valsB, paired);
 		}
+#endif
+		if (liveA) tsf_voice_render_lowpass(&a, valsA + paired, countA - paired);
+		if (liveB) tsf_voice_render_lowpass(&b, valsB + paired, countB - paired);
 
-		if (tmpSourceSamplePosition >= tmpSampleEndDbl || v->ampenv.segment == TSF_SEGMENT_DONE)
+		if (liveA)
 		{
-			tsf_voice_kill(v);
-			return;
+			tsf_voice_render_mix(f, &a, valsA, countA, outputBuffer, offset, numSamples);
+			if (a.sourceSamplePosition >= a.sampleEndDbl || va->ampenv.segment == TSF_SEGMENT_DONE)
+				tsf_voice_kill(va), liveA = TSF_FALSE;
 		}
+		if (liveB)
+		{
+			tsf_voice_render_mix(f, &b, valsB, countB, outputBuffer, offset, numSamples);
+			if (b.sourceSamplePosition >= b.sampleEndDbl || vb->ampenv.segment == TSF_SEGMENT_DONE)
+				tsf_voice_kill(vb), liveB = TSF_FALSE;
+		}
+
+		offset += blockSamples;
 	}
 
-	v->sourceSamplePosition = tmpSourceSamplePosition;
-	if (tmpLowpass.active || dynamicLowpass) v->lowpass = tmpLowpass;
+	if (liveA)
+	{
+		va->sourceSamplePosition = a.sourceSamplePosition;
+		if (a.lowpass.active || a.dynamicLowpass) va->lowpass = a.lowpass;
+	}
+	if (liveB)
+	{
+		vb->sourceSamplePosition = b.sourceSamplePosition;
+		if (b.lowpass.active || b.dynamicLowpass) vb->lowpass = b.lowpass;
+	}
 }
 
 TSFDEF tsf* tsf_load(struct tsf_stream* stream)
@@ -1289,13 +1410,32 @@ TSFDEF void tsf_close(tsf* f)
 	TSF_FREE(f);
 }
 
+static void tsf_channel_setdefaults(struct tsf_channel* c)
+{
+	c->presetIndex = c->bank = 0;
+	c->pitchWheel = c->midiPan = 8192;
+	c->midiVolume = c->midiExpression = 16383;
+	c->midiRPN = 0xFFFF;
+	c->midiData = 0;
+	c->panOffset = 0.0f;
+	c->gainDB = 0.0f;
+	c->pitchRange = 2.0f;
+	c->tuning = 0.0f;
+}
+
 TSFDEF void tsf_reset(tsf* f)
 {
 	struct tsf_voice *v = f->voices, *vEnd = v + f->voiceNum;
+	int i;
 	for (; v != vEnd; v++)
 		if (v->playingPreset != -1 && (v->ampenv.segment < TSF_SEGMENT_RELEASE || v->ampenv.parameters.release))
 			tsf_voice_endquick(f, v);
-	if (f->channels) { TSF_FREE(f->channels->channels); TSF_FREE(f->channels); f->channels = TSF_NULL; }
+	// Channels are reset in place, so that a reset does not need to allocate them again.
+	if (f->channels)
+	{
+		for (i = 0; i < f->channels->channelNum; i++) tsf_channel_setdefaults(&f->channels->channels[i]);
+		f->channels->activeChannel = 0;
+	}
 }
 
 TSFDEF int tsf_get_presetindex(const tsf* f, int bank, int preset_number)
@@ -1340,10 +1480,27 @@ TSFDEF void tsf_set_max_voices(tsf* f, int max_voices)
 	int i = f->voiceNum;
 	f->voiceNum = f->maxVoiceNum = (f->voiceNum > max_voices ? f->voiceNum : max_voices);
 	f->voices = (struct tsf_voice*)TSF_REALLOC(f->voices, f->voiceNum * sizeof(struct tsf_voice));
-	for (; i != max_voices; i++)
+	for (; i < f->voiceNum; i++)
 		f->voices[i].playingPreset = -1;
 }
 
+TSFDEF void tsf_set_voice_stealing(tsf* f, int flag_steal)
+{
+	f->voiceStealing = flag_steal;
+}
+
+static struct tsf_voice* tsf_voice_steal(tsf* f, unsigned int playIndex)
+{
+	struct tsf_voice *v = f->voices, *vEnd = v + f->voiceNum, *vReleased = TSF_NULL, *vOldest = TSF_NULL;
+	for (; v != vEnd; v++)
+	{
+		if (v->playIndex == playIndex) continue; // other regions of the note being started
+		if (v->ampenv.segment >= TSF_SEGMENT_RELEASE) { if (!vReleased || v->ampenv.level < vReleased->ampenv.level) vReleased = v; }
+		else if (!vOldest || v->playIndex < vOldest->playIndex) vOldest = v;
+	}
+	return (vReleased ? vReleased : vOldest);
+}
+
 TSFDEF void tsf_note_on(tsf* f, int preset_index, int key, float vel)
 {
 	short midiVelocity = (short)(vel * 127);
@@ -1373,13 +1530,16 @@ TSFDEF void tsf_note_on(tsf* f, int preset_index, int key, float vel)
 		{
 			if (f->maxVoiceNum)
 			{
-				// voices have been pre-allocated and limited to a maximum, unable to start playing this voice
-				continue;
+				// voices have been pre-allocated and limited to a maximum, steal one or skip this voice
+				if (!f->voiceStealing || !(voice = tsf_voice_steal(f, voicePlayIndex))) continue;
+			}
+			else
+			{
+				f->voiceNum += 4;
+				f->voices = (struct tsf_voice*)TSF_REALLOC(f->voices, f->voiceNum * sizeof(struct tsf_voice));
+				voice = &f->voices[f->voiceNum - 4];
+				voice[1].playingPreset = voice[2].playingPreset = voice[3].playingPreset = -1;
 			}
-			f->voiceNum += 4;
-			f->voices = (struct tsf_voice*)TSF_REALLOC(f->voices, f->voiceNum * sizeof(struct tsf_voice));
-			voice = &f->voices[f->voiceNum - 4];
-			voice[1].playingPreset = voice[2].playingPreset = voice[3].playingPreset = -1;
 		}
 
 		voice->region = region;
@@ -1509,11 +1669,23 @@ TSFDEF void tsf_render_short(tsf* f, short* buffer, int samples, int flag_mixing
 
 TSFDEF void tsf_render_float(tsf* f, float* buffer, int samples, int flag_mixing)
 {
-	struct tsf_voice *v = f->voices, *vEnd = v + f->voiceNum;
 	if (!flag_mixing) TSF_MEMSET(buffer, 0, (f->outputmode == TSF_MONO ? 1 : 2) * sizeof(float) * samples);
-	for (; v != vEnd; v++)
-		if (v->playingPreset != -1)
-			tsf_voice_render(f, v, buffer, samples);
+	tsf_render_float_voices(f, buffer, samples, 0, 1);
+}
+
+TSFDEF void tsf_render_float_voices(tsf* f, float* buffer, int samples, int first, int step)
+{
+	struct tsf_voice *v, *pending = TSF_NULL;
+	int i;
+	for (i = first; i < f->voiceNum; i += step)
+	{
+		v = &f->voices[i];
+		if (v->playingPreset == -1) continue;
+		if (!pending) { pending = v; continue; }
+		tsf_voice_render_pair(f, pending, v, buffer, samples);
+		pending = TSF_NULL;
+	}
+	if (pending) tsf_voice_render_pair(f, pending, TSF_NULL, buffer, samples);
 }
 
 static void tsf_channel_setup_voice(tsf* f, struct tsf_voice* v)
@@ -1544,18 +1716,7 @@ static struct tsf_channel* tsf_channel_init(tsf* f, int channel)
 	f->channels->channelNum = channel + 1;
 	f->channels->channels = (struct tsf_channel*)TSF_REALLOC(f->channels->channels, f->channels->channelNum * sizeof(struct tsf_channel));
 	for (; i <= channel; i++)
-	{
-		struct tsf_channel* c = &f->channels->channels[i];
-		c->presetIndex = c->bank = 0;
-		c->pitchWheel = c->midiPan = 8192;
-		c->midiVolume = c->midiExpression = 16383;
-		c->midiRPN = 0xFFFF;
-		c->midiData = 0;
-		c->panOffset = 0.0f;
-		c->gainDB = 0.0f;
-		c->pitchRange = 2.0f;
-		c->tuning = 0.0f;
-	}
+		tsf_channel_setdefaults(&f->channels->channels[i]);
 	return &f->channels->channels[channel];
 }
 
@@ -26,13 +26,12 @@
 #include "w_file.h"
 
 
-extern wad_file_class_t memio_wad_file;
+// The in-memory IWAD of the backend comes first, other
+// files (PWADs, demo lumps) are mapped where possible and read with
+// stdio otherwise.
 
-/* SOKOL CHANGE
+extern wad_file_class_t memio_wad_file;
 extern wad_file_class_t stdc_wad_file;
-#ifdef _WIN32
-extern wad_file_class_t win32_wad_file;
-#endif
 
 #ifdef HAVE_MMAP
 extern wad_file_class_t posix_wad_file;
@@ -40,34 +39,18 @@ extern wad_file_class_t posix_wad_file;
 
 static wad_file_class_t *wad_file_classes[] = 
 {
-#ifdef _WIN32
-    &win32_wad_file,
-#endif
+    &memio_wad_file,
 #ifdef HAVE_MMAP
     &posix_wad_file,
 #endif
     &stdc_wad_file,
 };
-*/
 
 wad_file_t *W_OpenFile(char *path)
 {
-    return memio_wad_file.OpenFile(path);
-
-    /* SOKOL CHANGE
     wad_file_t *result;
     int i;
 
-    //!
-    // Use the OS's virtual memory subsystem to map WAD files
-    // directly into memory.
-    //
-
-    if (!M_CheckParm("-mmap"))
-    {
-        return stdc_wad_file.OpenFile(path);
-    }
-
     // Try all classes in order until we find one that works
 
     result = NULL;
@@ -83,7 +66,6 @@ wad_file_t *W_OpenFile(char *path)
     }
 
     return result;
-    */
 }
 
 void W_CloseFile(wad_file_t *wad)
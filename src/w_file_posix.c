@@ -0,0 +1,186 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	WAD I/O functions, using mmap() to map WAD files into memory.
+//
+
+#include "config.h"
+
+#ifdef HAVE_MMAP
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "w_file.h"
+#include "z_zone.h"
+
+typedef struct
+{
+    wad_file_t wad;
+    int handle;
+} posix_wad_file_t;
+
+extern wad_file_class_t posix_wad_file;
+
+static void MapFile(posix_wad_file_t *wad, char *filename)
+{
+    void *result;
+
+    // The mapping is private and writable: lumps are handed out as
+    // pointers into it, and any code that touches lump data in place
+    // must only ever change our copy, never the file on disk.
+
+    result = mmap(NULL, wad->wad.length, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE, wad->handle, 0);
+
+    if (result == MAP_FAILED)
+    {
+        fprintf(stderr, "W_Posix_MapFile: Unable to mmap() %s - %s\n",
+                filename, strerror(errno));
+        wad->wad.mapped = NULL;
+    }
+    else
+    {
+        wad->wad.mapped = result;
+    }
+}
+
+static wad_file_t *W_Posix_OpenFile(char *path)
+{
+    posix_wad_file_t *result;
+    struct stat st;
+    int handle;
+
+    handle = open(path, O_RDONLY);
+
+    if (handle < 0)
+    {
+        return NULL;
+    }
+
+    if (fstat(handle, &st) < 0 || st.st_size == 0)
+    {
+        close(handle);
+        return NULL;
+    }
+
+    // Create a new posix_wad_file_t to hold the file handle.
+
+    result = Z_Malloc(sizeof(posix_wad_file_t), PU_STATIC, 0);
+    result->wad.file_class = &posix_wad_file;
+    result->wad.length = st.st_size;
+    result->handle = handle;
+
+    // Try to map the file into memory with mmap; if that fails we
+    // still work through W_Posix_Read, just without zero-copy lumps.
+
+    MapFile(result, path);
+
+    return &result->wad;
+}
+
+static void W_Posix_CloseFile(wad_file_t *wad)
+{
+    posix_wad_file_t *posix_wad;
+
+    posix_wad = (posix_wad_file_t *) wad;
+
+    if (posix_wad->wad.mapped != NULL)
+    {
+        munmap(posix_wad->wad.mapped, posix_wad->wad.length);
+    }
+
+    close(posix_wad->handle);
+    Z_Free(posix_wad);
+}
+
+// Read data from the specified position in the file into the
+// provided buffer.  Returns the number of bytes read.
+
+static size_t W_Posix_Read(wad_file_t *wad, unsigned int offset,
+                           void *buffer, size_t buffer_len)
+{
+    posix_wad_file_t *posix_wad;
+    byte *byte_buffer;
+    size_t bytes_read;
+    ssize_t result;
+
+    posix_wad = (posix_wad_file_t *) wad;
+
+    if (posix_wad->wad.mapped != NULL)
+    {
+        if (offset >= posix_wad->wad.length)
+        {
+            return 0;
+        }
+
+        if (buffer_len > posix_wad->wad.length - offset)
+        {
+            buffer_len = posix_wad->wad.length - offset;
+        }
+
+        memcpy(buffer, posix_wad->wad.mapped + offset, buffer_len);
+
+        return buffer_len;
+    }
+
+    // Not mapped: read from the file descriptor.
+
+    bytes_read = 0;
+    byte_buffer = buffer;
+
+    while (buffer_len > 0)
+    {
+        result = pread(posix_wad->handle, byte_buffer, buffer_len,
+                       offset + bytes_read);
+
+        if (result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            perror("W_Posix_Read");
+            break;
+        }
+        else if (result == 0)
+        {
+            break;
+        }
+
+        byte_buffer += result;
+        buffer_len -= result;
+        bytes_read += result;
+    }
+
+    return bytes_read;
+}
+
+
+wad_file_class_t posix_wad_file =
+{
+    W_Posix_OpenFile,
+    W_Posix_CloseFile,
+    W_Posix_Read,
+};
+
+#endif /* #ifdef HAVE_MMAP */
@@ -17,8 +17,11 @@
 //
 
 
+#include <string.h>
+
 #include "z_zone.h"
 #include "i_system.h"
+#include "m_argv.h"
 #include "doomtype.h"
 
 
@@ -44,6 +47,7 @@ typedef struct memblock_s
     int			id;	// should be ZONEID
     struct memblock_s*	next;
     struct memblock_s*	prev;
+    struct memblock_s*	freelink[2];	// free list / tree links (segfit)
 } memblock_t;
 
 
@@ -63,6 +67,15 @@ typedef struct
 
 memzone_t*	mainzone;
 
+static zonestats_t zonestats;
+
+static boolean segfit;
+
+static memblock_t *SF_Malloc (int size);
+static memblock_t *SF_Release (memblock_t *block);
+static void SF_Init (void);
+static void Z_ResetPools (int lowtag, int hightag);
+
 
 
 //
@@ -98,6 +111,7 @@ void Z_Init (void)
 {
     memblock_t*	block;
     int		size;
+    int		p;
 
     mainzone = (memzone_t *)I_ZoneBase (&size);
     mainzone->size = size;
@@ -117,6 +131,28 @@ void Z_Init (void)
     block->tag = PU_FREE;
     
     block->size = mainzone->size - sizeof(memzone_t);
+
+    //!
+    // @arg <allocator>
+    //
+    // Zone heap allocator: "classic" (first fit with a rover, the
+    // default) or "segfit" (size class free lists and a best fit
+    // tree for large blocks).
+    //
+
+    p = M_CheckParmWithArgs("-zonealloc", 1);
+
+    if (p > 0 && !strcmp(myargv[p + 1], "segfit"))
+    {
+        segfit = true;
+        SF_Init();
+    }
+    else if (p > 0 && strcmp(myargv[p + 1], "classic") != 0)
+    {
+        I_Error("Z_Init: unknown allocator '%s'", myargv[p + 1]);
+    }
+
+    zonestats.allocator = segfit ? "segfit" : "classic";
 }
 
 
@@ -143,6 +179,14 @@ void Z_Free (void* ptr)
     block->tag = PU_FREE;
     block->user = NULL;
     block->id = 0;
+
+    ++zonestats.frees;
+
+    if (segfit)
+    {
+        SF_Release(block);
+        return;
+    }
 	
     other = block->prev;
 
@@ -174,25 +218,22 @@ void Z_Free (void* ptr)
 
 
 
-//
-// Z_Malloc
-// You can pass a NULL user if the tag is < PU_PURGELEVEL.
-//
 #define MINFRAGMENT		64
 
 
-void*
-Z_Malloc
-( int		size,
-  int		tag,
-  void*		user )
+//
+// Z_FirstFit
+// The classic allocator: walk the block list from the rover,
+// purging cache blocks on the way, and split the first free
+// block that fits.
+//
+static memblock_t *Z_FirstFit (int size)
 {
     int		extra;
     memblock_t*	start;
     memblock_t* rover;
     memblock_t* newblock;
     memblock_t*	base;
-    void *result;
 
     size = (size + MEM_ALIGN - 1) & ~(MEM_ALIGN - 1);
     
@@ -216,6 +257,8 @@ Z_Malloc
 	
     do
     {
+        ++zonestats.visited;
+
         if (rover == start)
         {
             // scanned all the way around the list
@@ -236,6 +279,7 @@ Z_Malloc
 
                 // the rover can be the base block
                 base = base->prev;
+                ++zonestats.purges;
                 Z_Free ((byte *)rover+sizeof(memblock_t));
                 base = base->next;
                 rover = base->next;
@@ -267,9 +311,37 @@ Z_Malloc
         base->next = newblock;
         base->size = size;
     }
-	
-	if (user == NULL && tag >= PU_PURGELEVEL)
-	    I_Error ("Z_Malloc: an owner is required for purgable blocks");
+
+    // next allocation will start looking here
+    mainzone->rover = base->next;	
+
+    return base;
+}
+
+
+
+//
+// Z_Malloc
+// You can pass a NULL user if the tag is < PU_PURGELEVEL.
+//
+void*
+Z_Malloc
+( int		size,
+  int		tag,
+  void*		user )
+{
+    memblock_t*	base;
+    void *result;
+
+    ++zonestats.mallocs;
+
+    if (segfit)
+        base = SF_Malloc (size);
+    else
+        base = Z_FirstFit (size);
+
+    if (user == NULL && tag >= PU_PURGELEVEL)
+        I_Error ("Z_Malloc: an owner is required for purgable blocks");
 
     base->user = user;
     base->tag = tag;
@@ -281,10 +353,8 @@ Z_Malloc
         *base->user = result;
     }
 
-    // next allocation will start looking here
-    mainzone->rover = base->next;	
-	
     base->id = ZONEID;
+    zonestats.bytes += base->size;
     
     return result;
 }
@@ -301,6 +371,8 @@ Z_FreeTags
 {
     memblock_t*	block;
     memblock_t*	next;
+
+    Z_ResetPools (lowtag, hightag);
 	
     for (block = mainzone->blocklist.next ;
 	 block != &mainzone->blocklist ;
@@ -486,3 +558,570 @@ unsigned int Z_ZoneSize(void)
     return mainzone->size;
 }
 
+
+void Z_GetStats(zonestats_t *stats)
+{
+    *stats = zonestats;
+}
+
+
+
+//
+// SLAB POOLS
+//
+// Objects of one size are carved out of slabs, zone blocks holding
+// perslab of them, and recycled through a free list.  Objects
+// allocated together sit next to each other, and allocating or
+// freeing one never walks the zone.
+//
+// Each slot starts with a header naming its pool, so Z_PoolFree
+// needs only the pointer.  The free list link is kept there too:
+// like Z_Free, freeing leaves the object itself untouched.
+//
+
+typedef struct zslot_s
+{
+    zpool_t*		pool;
+    struct zslot_s*	nextfree;
+} zslot_t;
+
+static zpool_t*	pools;
+
+
+//
+// Z_PoolInit
+// Once per pool; the pool stays registered for good.
+//
+void Z_PoolInit (zpool_t *pool, int size, int perslab, int tag)
+{
+    size = (size + MEM_ALIGN - 1) & ~(MEM_ALIGN - 1);
+
+    pool->size = sizeof(zslot_t) + size;
+    pool->perslab = perslab;
+    pool->tag = tag;
+    pool->freelist = NULL;
+    pool->carve = pool->carveend = NULL;
+
+    pool->nextpool = pools;
+    pools = pool;
+}
+
+
+//
+// Z_PoolAlloc
+// Like Z_Malloc, the object is not cleared.
+//
+void *Z_PoolAlloc (zpool_t *pool)
+{
+    zslot_t*	slot;
+
+    ++zonestats.poolallocs;
+
+    if (pool->freelist)
+    {
+	slot = pool->freelist;
+	pool->freelist = slot->nextfree;
+    }
+    else
+    {
+	if (pool->carve == pool->carveend)
+	{
+	    pool->carve = Z_Malloc (pool->size * pool->perslab, pool->tag, NULL);
+	    pool->carveend = pool->carve + pool->size * pool->perslab;
+	    ++zonestats.slabs;
+	}
+
+	slot = (zslot_t *) pool->carve;
+	pool->carve += pool->size;
+    }
+
+    slot->pool = pool;
+    slot->nextfree = NULL;
+
+    return slot + 1;
+}
+
+
+//
+// Z_PoolFree
+//
+void Z_PoolFree (void *ptr)
+{
+    zslot_t*	slot;
+    zpool_t*	pool;
+
+    slot = (zslot_t *) ptr - 1;
+    pool = slot->pool;
+
+    if (pool == NULL)
+	I_Error ("Z_PoolFree: freed a slot twice");
+
+    ++zonestats.poolfrees;
+
+    slot->pool = NULL;
+    slot->nextfree = pool->freelist;
+    pool->freelist = slot;
+}
+
+
+//
+// Z_ResetPools
+// Forget the slabs Z_FreeTags is about to release.
+//
+static void Z_ResetPools (int lowtag, int hightag)
+{
+    zpool_t*	pool;
+
+    for (pool = pools ; pool ; pool = pool->nextpool)
+    {
+	if (pool->tag >= lowtag && pool->tag <= hightag)
+	{
+	    pool->freelist = NULL;
+	    pool->carve = pool->carveend = NULL;
+	}
+    }
+}
+
+
+
+//
+// SEGREGATED FIT ALLOCATOR
+//
+// Selected with -zonealloc segfit.  Uses the same block list as the
+// classic allocator, so tags, purging, user pointers and the heap
+// checks above all work unchanged; only the search for a free block
+// differs.
+//
+// Free blocks up to SF_SMALLMAX bytes (header included) are kept on
+// one list per exact size, with a bitmap of non-empty lists.  Larger
+// free blocks live in a treap ordered by size and then address, so
+// a lookup finds the smallest, lowest addressed block that fits.
+// Purgable blocks are only reclaimed when neither has room.
+//
+// The list and tree links are kept in the block header rather than
+// the body: some callers (P_RunThinkers) still read a block after
+// freeing it, which only works if freeing leaves the body alone.
+//
+
+#define SF_SMALLMAX     1024
+#define SF_NUMCLASSES   (SF_SMALLMAX / MEM_ALIGN + 1)
+#define SF_MAPWORDS     ((SF_NUMCLASSES + 31) / 32)
+
+// size class list links
+#define NEXTFREE(block) ((block)->freelink[0])
+#define PREVFREE(block) ((block)->freelink[1])
+
+// tree links
+#define LEFT(block)     ((block)->freelink[0])
+#define RIGHT(block)    ((block)->freelink[1])
+
+static memblock_t *sizeclass[SF_NUMCLASSES];
+static unsigned int classmap[SF_MAPWORDS];
+static memblock_t *freetree;
+
+// Where the next purge scan starts.
+static memblock_t *purgerover;
+
+//
+// Size class lists
+//
+
+static void SF_LinkClass (memblock_t *block)
+{
+    int c = block->size / MEM_ALIGN;
+
+    PREVFREE(block) = NULL;
+    NEXTFREE(block) = sizeclass[c];
+
+    if (sizeclass[c] != NULL)
+    {
+        PREVFREE(sizeclass[c]) = block;
+    }
+
+    sizeclass[c] = block;
+    classmap[c >> 5] |= 1u << (c & 31);
+}
+
+static void SF_UnlinkClass (memblock_t *block)
+{
+    int c = block->size / MEM_ALIGN;
+
+    if (PREVFREE(block) != NULL)
+    {
+        NEXTFREE(PREVFREE(block)) = NEXTFREE(block);
+    }
+    else
+    {
+        sizeclass[c] = NEXTFREE(block);
+    }
+
+    if (NEXTFREE(block) != NULL)
+    {
+        PREVFREE(NEXTFREE(block)) = PREVFREE(block);
+    }
+
+    if (sizeclass[c] == NULL)
+    {
+        classmap[c >> 5] &= ~(1u << (c & 31));
+    }
+}
+
+// Lowest non-empty size class >= c, or -1.
+
+static int SF_FindClass (int c)
+{
+    unsigned int bits;
+    int word;
+
+    word = c >> 5;
+    bits = classmap[word] & (~0u << (c & 31));
+
+    ++zonestats.visited;
+
+    while (bits == 0)
+    {
+        if (++word >= SF_MAPWORDS)
+        {
+            return -1;
+        }
+
+        bits = classmap[word];
+        ++zonestats.visited;
+    }
+
+    c = word << 5;
+
+    while ((bits & 1) == 0)
+    {
+        bits >>= 1;
+        ++c;
+    }
+
+    return c;
+}
+
+//
+// Large block treap.  The heap priority is a hash of the block
+// address, which keeps the tree balanced without storing anything
+// extra in the block.
+//
+
+static unsigned int SF_Priority (memblock_t *block)
+{
+    return (unsigned int) ((uintptr_t) block / MEM_ALIGN) * 2654435761u;
+}
+
+static boolean SF_Before (memblock_t *a, memblock_t *b)
+{
+    return a->size < b->size || (a->size == b->size && a < b);
+}
+
+static memblock_t *SF_TreeInsert (memblock_t *root, memblock_t *block)
+{
+    memblock_t *child;
+
+    if (root == NULL)
+    {
+        LEFT(block) = RIGHT(block) = NULL;
+        return block;
+    }
+
+    if (SF_Before(block, root))
+    {
+        child = SF_TreeInsert(LEFT(root), block);
+        LEFT(root) = child;
+
+        if (SF_Priority(child) > SF_Priority(root))
+        {
+            // rotate right
+            LEFT(root) = RIGHT(child);
+            RIGHT(child) = root;
+            return child;
+        }
+    }
+    else
+    {
+        child = SF_TreeInsert(RIGHT(root), block);
+        RIGHT(root) = child;
+
+        if (SF_Priority(child) > SF_Priority(root))
+        {
+            // rotate left
+            RIGHT(root) = LEFT(child);
+            LEFT(child) = root;
+            return child;
+        }
+    }
+
+    return root;
+}
+
+// Join two treaps where everything in a sorts before everything in b.
+
+static memblock_t *SF_TreeJoin (memblock_t *a, memblock_t *b)
+{
+    if (a == NULL)
+    {
+        return b;
+    }
+
+    if (b == NULL)
+    {
+        return a;
+    }
+
+    if (SF_Priority(a) > SF_Priority(b))
+    {
+        RIGHT(a) = SF_TreeJoin(RIGHT(a), b);
+        return a;
+    }
+    else
+    {
+        LEFT(b) = SF_TreeJoin(a, LEFT(b));
+        return b;
+    }
+}
+
+static memblock_t *SF_TreeRemove (memblock_t *root, memblock_t *block)
+{
+    if (root == block)
+    {
+        return SF_TreeJoin(LEFT(root), RIGHT(root));
+    }
+
+    if (root == NULL)
+    {
+        I_Error ("SF_TreeRemove: free block not in tree");
+    }
+
+    if (SF_Before(block, root))
+    {
+        LEFT(root) = SF_TreeRemove(LEFT(root), block);
+    }
+    else
+    {
+        RIGHT(root) = SF_TreeRemove(RIGHT(root), block);
+    }
+
+    return root;
+}
+
+// Smallest block of at least size bytes, or NULL.
+
+static memblock_t *SF_TreeFind (int size)
+{
+    memblock_t *node;
+    memblock_t *best;
+
+    best = NULL;
+
+    for (node = freetree; node != NULL; )
+    {
+        ++zonestats.visited;
+
+        if (node->size >= size)
+        {
+            best = node;
+            node = LEFT(node);
+        }
+        else
+        {
+            node = RIGHT(node);
+        }
+    }
+
+    return best;
+}
+
+//
+// Free block bookkeeping
+//
+
+static void SF_Link (memblock_t *block)
+{
+    if (block->size <= SF_SMALLMAX)
+        SF_LinkClass (block);
+    else
+        freetree = SF_TreeInsert (freetree, block);
+}
+
+static void SF_Unlink (memblock_t *block)
+{
+    if (block->size <= SF_SMALLMAX)
+        SF_UnlinkClass (block);
+    else
+        freetree = SF_TreeRemove (freetree, block);
+}
+
+static void SF_Init (void)
+{
+    memset(sizeclass, 0, sizeof(sizeclass));
+    memset(classmap, 0, sizeof(classmap));
+    freetree = NULL;
+
+    purgerover = mainzone->blocklist.next;
+
+    SF_Link (mainzone->blocklist.next);
+}
+
+//
+// SF_Release
+// Called by Z_Free once the block is marked free: merge it with any
+// free neighbours and file the result.  Returns the merged block.
+//
+static memblock_t *SF_Release (memblock_t *block)
+{
+    memblock_t *other;
+
+    other = block->prev;
+
+    if (other->tag == PU_FREE)
+    {
+        SF_Unlink (other);
+
+        other->size += block->size;
+        other->next = block->next;
+        other->next->prev = other;
+
+        if (block == purgerover)
+            purgerover = other;
+
+        block = other;
+    }
+
+    other = block->next;
+
+    if (other->tag == PU_FREE)
+    {
+        SF_Unlink (other);
+
+        block->size += other->size;
+        block->next = other->next;
+        block->next->prev = block;
+
+        if (other == purgerover)
+            purgerover = block;
+    }
+
+    SF_Link (block);
+
+    return block;
+}
+
+//
+// SF_Purge
+// No free block is big enough: walk the heap from the purge rover,
+// releasing purgable blocks until one of the merged free blocks
+// fits.  Returns it unlinked from the free lists.
+//
+static memblock_t *SF_Purge (int size)
+{
+    memblock_t *rover;
+    boolean wrapped;
+
+    rover = purgerover;
+    wrapped = false;
+
+    for (;;)
+    {
+        ++zonestats.visited;
+
+        if (rover == &mainzone->blocklist)
+        {
+            if (wrapped)
+            {
+                I_Error ("Z_Malloc: failed on allocation of %i bytes", size);
+            }
+
+            wrapped = true;
+            rover = rover->next;
+            continue;
+        }
+
+        if (rover->tag >= PU_PURGELEVEL)
+        {
+            // same as Z_Free, but keep hold of the merged block
+            if (rover->user != NULL)
+                *rover->user = 0;
+
+            rover->tag = PU_FREE;
+            rover->user = NULL;
+            rover->id = 0;
+
+            ++zonestats.frees;
+            ++zonestats.purges;
+
+            rover = SF_Release (rover);
+
+            if (rover->size >= size)
+            {
+                SF_Unlink (rover);
+                purgerover = rover->next;
+                return rover;
+            }
+        }
+
+        rover = rover->next;
+    }
+}
+
+static memblock_t *SF_Malloc (int size)
+{
+    memblock_t *base;
+    memblock_t *newblock;
+    int extra;
+    int c;
+
+    size = (size + MEM_ALIGN - 1) & ~(MEM_ALIGN - 1);
+    size += sizeof(memblock_t);
+
+    base = NULL;
+
+    if (size <= SF_SMALLMAX)
+    {
+        c = SF_FindClass (size / MEM_ALIGN);
+
+        if (c >= 0)
+        {
+            base = sizeclass[c];
+            SF_UnlinkClass (base);
+        }
+    }
+
+    if (base == NULL)
+    {
+        base = SF_TreeFind (size);
+
+        if (base != NULL)
+        {
+            freetree = SF_TreeRemove (freetree, base);
+        }
+        else
+        {
+            base = SF_Purge (size);
+        }
+    }
+
+    extra = base->size - size;
+
+    if (extra > MINFRAGMENT)
+    {
+        // the remainder goes back on the free lists; the next block
+        // is in use, so there is nothing to merge with
+        newblock = (memblock_t *) ((byte *)base + size);
+        newblock->size = extra;
+        newblock->tag = PU_FREE;
+        newblock->user = NULL;
+        newblock->id = 0;
+        newblock->prev = base;
+        newblock->next = base->next;
+        newblock->next->prev = newblock;
+
+        base->next = newblock;
+        base->size = size;
+
+        SF_Link (newblock);
+    }
+
+    return base;
+}
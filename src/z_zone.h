@@ -26,6 +26,8 @@
 
 #include <stdio.h>
 
+#include "doomtype.h"
+
 //
 // ZONE MEMORY
 // PU - purge tags.
@@ -49,6 +51,37 @@ enum
     PU_NUM_TAGS
 };
         
+//
+// Allocation counters, accumulated since Z_Init.
+//
+typedef struct
+{
+    char       *allocator;      // name of the active backend
+    uint64_t    mallocs;        // Z_Malloc calls
+    uint64_t    frees;          // blocks released, including purges
+    uint64_t    purges;         // purgable blocks reclaimed by Z_Malloc
+    uint64_t    bytes;          // bytes handed out, including headers
+    uint64_t    visited;        // blocks and free lists inspected by Z_Malloc
+    uint64_t    poolallocs;     // Z_PoolAlloc calls
+    uint64_t    poolfrees;      // Z_PoolFree calls
+    uint64_t    slabs;          // slabs taken from the zone by pools
+} zonestats_t;
+
+//
+// Slab pools of fixed size objects.  Slabs are zone blocks of the
+// pool's tag; Z_FreeTags releases them and empties the pool.
+//
+typedef struct zpool_s
+{
+    int                 size;       // slot size, header included
+    int                 perslab;    // slots per slab
+    int                 tag;
+    struct zslot_s*     freelist;   // slots released by Z_PoolFree
+    byte*               carve;      // next unused slot of the newest slab
+    byte*               carveend;
+    struct zpool_s*     nextpool;   // all pools, for Z_FreeTags
+} zpool_t;
+
 
 void	Z_Init (void);
 void*	Z_Malloc (int size, int tag, void *ptr);
@@ -61,6 +94,11 @@ void    Z_ChangeTag2 (void *ptr, int tag, char *file, int line);
 void    Z_ChangeUser(void *ptr, void **user);
 int     Z_FreeMemory (void);
 unsigned int Z_ZoneSize(void);
+void    Z_GetStats (zonestats_t *stats);
+
+void    Z_PoolInit (zpool_t *pool, int size, int perslab, int tag);
+void*   Z_PoolAlloc (zpool_t *pool);
+void    Z_PoolFree (void *ptr);
 
 //
 // This is used to get the local FILE:LINE info from CPP